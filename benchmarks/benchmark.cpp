@@ -0,0 +1,536 @@
+#include "command_buffer.h"
+#include "entity.h"
+#include "expiry.h"
+#include "index.h"
+#include "snapshot.h"
+#include "system.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+Microbenchmarks for adding, getting, removing and iterating components expiring entities, snapshots and deltas.
+Usage: ecs_benchmark [--min-entities N] [--max-entities N] [--output file.json]
+Every benchmark runs for 10^3, 10^4, ... entities up to --max-entities (default 10^7) and the results are written as JSON to stdout or the output file.
+ns_per_op is the time of one operation, ns_per_entity is the time of the whole benchmark divided by the number of entities.
+Sparse overlap: every entity has a Position, every 10th entity has a Velocity and every 100th entity a Health.
+Dense overlap: every entity has all 3 components.
+Tags: every entity has a Position and every 10th entity is Frozen.
+Index: hp of every entity is one of 0 to 999, lookups find the 1% of entities with hp below 10.
+*/
+
+namespace {
+	struct Position {
+		float x, y;
+	};
+	struct Velocity {
+		float dx, dy;
+	};
+	struct Health {
+		int hp, max_hp;
+	};
+	struct Sparse_health {
+		int hp, max_hp;
+	};
+	struct Tracked_position {
+		float x, y;
+	};
+	struct Tracked_health {
+		int hp, max_hp;
+	};
+	//the same marker as a tag and as a regular component with a dummy member
+	struct Frozen {};
+	struct Frozen_component {
+		bool unused;
+	};
+	//same particle stored as array of structs and as structure of arrays
+	struct Aos_particle {
+		int life_time;
+		float x, y, z, vx, vy, vz, mass;
+	};
+	struct Soa_particle {
+		int life_time;
+		float x, y, z, vx, vy, vz, mass;
+	};
+} // namespace
+
+template <>
+struct ECS::Storage_policy<Sparse_health> {
+	using type = ECS::Sparse_set_storage;
+};
+template <>
+struct ECS::Storage_policy<Tracked_position> {
+	using type = ECS::Sorted_storage;
+	static constexpr bool track_changes = true;
+};
+template <>
+struct ECS::Storage_policy<Tracked_health> {
+	using type = ECS::Sorted_storage;
+	static constexpr bool track_changes = true;
+};
+template <>
+struct ECS::Storage_policy<Soa_particle> {
+	using type = ECS::Column_storage;
+	static constexpr auto columns = std::make_tuple(&Soa_particle::life_time, &Soa_particle::x, &Soa_particle::y, &Soa_particle::z, &Soa_particle::vx,
+													&Soa_particle::vy, &Soa_particle::vz, &Soa_particle::mass);
+};
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	struct Result {
+		std::string name;
+		std::size_t entities;
+		const char *overlap;
+		std::size_t operations;
+		double seconds;
+	};
+	std::vector<Result> results;
+
+	//prevent the compiler from removing computations whose result is not used
+	volatile float sink;
+
+	double seconds_since(Clock::time_point start) {
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+	//run f once and record the time
+	template <class Function>
+	void measure_once(const char *name, std::size_t entities, const char *overlap, std::size_t operations, Function &&f) {
+		const auto start = Clock::now();
+		f();
+		results.push_back({name, entities, overlap, operations, seconds_since(start)});
+	}
+	//run f repeatedly for at least min_seconds and record the fastest run
+	template <class Function>
+	void measure(const char *name, std::size_t entities, const char *overlap, std::size_t operations, Function &&f) {
+		constexpr double min_seconds = 0.2;
+		constexpr int min_runs = 3;
+		double fastest = -1;
+		double total = 0;
+		for (int run = 0; run < min_runs || total < min_seconds; run++) {
+			const auto start = Clock::now();
+			f();
+			const auto seconds = seconds_since(start);
+			total += seconds;
+			fastest = fastest < 0 ? seconds : std::min(fastest, seconds);
+		}
+		results.push_back({name, entities, overlap, operations, fastest});
+	}
+
+	//destroy entities with one pass over every pool instead of one erase per component
+	void destroy_all(std::vector<ECS::Entity> &entities) {
+		ECS::Command_buffer command_buffer;
+		for (auto &entity : entities) {
+			command_buffer.destroy(std::move(entity));
+		}
+		command_buffer.flush();
+		entities.clear();
+	}
+	std::vector<ECS::Entity_handle> random_handles(std::vector<ECS::Entity> &entities, std::size_t count) {
+		std::mt19937_64 rng(42);
+		std::vector<ECS::Entity_handle> handles;
+		handles.reserve(count);
+		for (std::size_t i = 0; i < count; i++) {
+			handles.push_back(entities[rng() % entities.size()].to_handle());
+		}
+		return handles;
+	}
+
+	void benchmark_storage(std::size_t n) {
+		std::vector<ECS::Entity> entities;
+		measure_once("create", n, nullptr, n, [&] { entities = ECS::Entity::create(n, Position{1, 2}, Velocity{3, 4}); });
+		measure_once("destroy", n, nullptr, n, [&] { destroy_all(entities); });
+
+		entities.resize(n);
+		measure_once("emplace", n, nullptr, n, [&] {
+			for (auto &entity : entities) {
+				entity.emplace<Position>(1.f, 2.f);
+			}
+		});
+		measure_once("emplace_sparse_set", n, nullptr, n, [&] {
+			for (auto &entity : entities) {
+				entity.emplace<Sparse_health>(1, 2);
+			}
+		});
+		const auto lookups = std::min<std::size_t>(n, 1000000);
+		const auto handles = random_handles(entities, lookups);
+		measure("get", n, nullptr, lookups, [&] {
+			float sum = 0;
+			for (auto handle : handles) {
+				sum += handle.get<Position>()->x;
+			}
+			sink = sum;
+		});
+		std::vector<Position *> found(lookups);
+		measure("get_batched", n, nullptr, lookups, [&] {
+			ECS::System::lookup(handles.data(), handles.size(), found.data());
+			float sum = 0;
+			for (auto position : found) {
+				sum += position->x;
+			}
+			sink = sum;
+		});
+		measure("get_sparse_set", n, nullptr, lookups, [&] {
+			float sum = 0;
+			for (auto handle : handles) {
+				sum += handle.get<Sparse_health>()->hp;
+			}
+			sink = sum;
+		});
+		//removing from a sorted pool moves all following components, so only a few are removed one by one
+		const auto removals = std::min<std::size_t>(n / 10, 100);
+		measure_once("remove", n, nullptr, removals, [&] {
+			for (std::size_t i = 0; i < removals; i++) {
+				entities[i * 10].remove<Position>();
+			}
+		});
+		measure_once("remove_sparse_set", n, nullptr, removals, [&] {
+			for (std::size_t i = 0; i < removals; i++) {
+				entities[i * 10].remove<Sparse_health>();
+			}
+		});
+		//every 10th entity starting at 5, so none of them lost its Position above
+		measure_once("remove_batched", n, nullptr, n / 10, [&] {
+			ECS::Command_buffer command_buffer;
+			for (std::size_t i = 0; i < n / 10; i++) {
+				command_buffer.remove<Position>(entities[i * 10 + 5].to_handle());
+			}
+			command_buffer.flush();
+		});
+		destroy_all(entities);
+	}
+
+	std::vector<ECS::Entity> make_entities(std::size_t n, bool dense) {
+		if (dense) {
+			return ECS::Entity::create(n, Position{1, 2}, Velocity{3, 4}, Health{5, 6});
+		}
+		auto entities = ECS::Entity::create(n, Position{1, 2});
+		ECS::Command_buffer command_buffer;
+		for (std::size_t i = 0; i < n; i += 10) {
+			command_buffer.emplace<Velocity>(entities[i].to_handle(), 3.f, 4.f);
+			if (i % 100 == 0) {
+				command_buffer.emplace<Health>(entities[i].to_handle(), 5, 6);
+			}
+		}
+		command_buffer.flush();
+		return entities;
+	}
+	//the join as it was done before galloping: advance every pool one id at a time
+	template <class Function>
+	void linear_merge(const std::vector<ECS::Impl::Id_t> &lhs, const std::vector<ECS::Impl::Id_t> &rhs, Function &&f) {
+		std::size_t l = 0;
+		std::size_t r = 0;
+		while (lhs[l] != ECS::Impl::max_id && rhs[r] != ECS::Impl::max_id) {
+			if (lhs[l] < rhs[r]) {
+				l++;
+			} else if (rhs[r] < lhs[l]) {
+				r++;
+			} else {
+				f(l++, r++);
+			}
+		}
+	}
+
+	void benchmark_iteration(std::size_t n, bool dense) {
+		const auto overlap = dense ? "dense" : "sparse";
+		auto entities = make_entities(n, dense);
+		measure("iterate_1", n, overlap, ECS::System::get_pool<Position>().size(), [] {
+			float sum = 0;
+			for (auto sit = ECS::System::range<const Position>(); sit; sit.advance()) {
+				sum += sit.get<const Position>().x;
+			}
+			sink = sum;
+		});
+		measure("iterate_2", n, overlap, ECS::System::get_pool<Velocity>().size(), [] {
+			for (auto sit = ECS::System::range<Position, const Velocity>(); sit; sit.advance()) {
+				sit.get<Position>().x += sit.get<const Velocity>().dx;
+			}
+		});
+		measure("iterate_3", n, overlap, ECS::System::get_pool<Health>().size(), [] {
+			for (auto sit = ECS::System::range<Position, const Velocity, const Health>(); sit; sit.advance()) {
+				sit.get<Position>().x += sit.get<const Velocity>().dx * sit.get<const Health>().hp;
+			}
+		});
+		//Position without Velocity and Position with Velocity if present, compared to looking up the Velocity of every entity
+		measure("iterate_not", n, overlap, ECS::System::get_pool<Position>().size() - ECS::System::get_pool<Velocity>().size(), [] {
+			float sum = 0;
+			for (auto sit = ECS::System::range<const Position, ECS::Not<Velocity>>(); sit; sit.advance()) {
+				sum += sit.get<const Position>().x;
+			}
+			sink = sum;
+		});
+		measure("iterate_optional", n, overlap, ECS::System::get_pool<Position>().size(), [] {
+			float sum = 0;
+			for (auto sit = ECS::System::range<const Position, ECS::Optional<const Velocity>>(); sit; sit.advance()) {
+				const auto velocity = sit.get<const Velocity>();
+				sum += sit.get<const Position>().x + (velocity ? velocity->dx : 0);
+			}
+			sink = sum;
+		});
+		measure("iterate_optional_get", n, overlap, ECS::System::get_pool<Position>().size(), [] {
+			float sum = 0;
+			for (auto sit = ECS::System::range<const Position>(); sit; sit.advance()) {
+				const auto velocity = sit.get_entity_handle().get<Velocity>();
+				sum += sit.get<const Position>().x + (velocity ? velocity->dx : 0);
+			}
+			sink = sum;
+		});
+		measure("linear_merge_2", n, overlap, ECS::System::get_pool<Velocity>().size(), [] {
+			auto &positions = ECS::System::get_components<Position>();
+			const auto &velocities = ECS::System::get_components<Velocity>();
+			linear_merge(ECS::System::get_ids<Position>(), ECS::System::get_ids<Velocity>(),
+						 [&](std::size_t p, std::size_t v) { positions[p].x += velocities[v].dx; });
+		});
+		measure("run_systems", n, overlap, ECS::System::get_pool<Velocity>().size(), [] { ECS::System::run_systems(); });
+		destroy_all(entities);
+	}
+
+	void benchmark_tags(std::size_t n) {
+		auto entities = ECS::Entity::create(n, Position{1, 2});
+		ECS::Command_buffer command_buffer;
+		for (std::size_t i = 0; i < n; i += 10) {
+			command_buffer.emplace<Frozen>(entities[i].to_handle());
+			command_buffer.emplace<Frozen_component>(entities[i].to_handle(), true);
+		}
+		command_buffer.flush();
+		measure("iterate_tag", n, nullptr, ECS::System::get_pool<Frozen>().size(), [] {
+			float sum = 0;
+			for (auto sit = ECS::System::range<const Position, Frozen>(); sit; sit.advance()) {
+				sum += sit.get<const Position>().x;
+			}
+			sink = sum;
+		});
+		measure("iterate_tag_as_component", n, nullptr, ECS::System::get_pool<Frozen_component>().size(), [] {
+			float sum = 0;
+			for (auto sit = ECS::System::range<const Position, const Frozen_component>(); sit; sit.advance()) {
+				sum += sit.get<const Position>().x;
+			}
+			sink = sum;
+		});
+		measure("iterate_not_tag", n, nullptr, n - ECS::System::get_pool<Frozen>().size(), [] {
+			float sum = 0;
+			for (auto sit = ECS::System::range<const Position, ECS::Not<Frozen>>(); sit; sit.advance()) {
+				sum += sit.get<const Position>().x;
+			}
+			sink = sum;
+		});
+		measure("has_tag", n, nullptr, n, [&entities] {
+			std::size_t frozen = 0;
+			for (auto &entity : entities) {
+				frozen += entity.get<Frozen>() != nullptr;
+			}
+			sink = static_cast<float>(frozen);
+		});
+		destroy_all(entities);
+	}
+
+	void benchmark_index(std::size_t n) {
+		std::vector<ECS::Entity> entities;
+		entities.reserve(n);
+		for (std::size_t i = 0; i < n; i++) {
+			entities.emplace_back();
+			entities.back().emplace<Tracked_health>(static_cast<int>(i * 7919 % 1000), 1000);
+			entities.back().emplace<Position>(1.f, 2.f);
+		}
+		const auto found = (n + 99) / 100;
+		measure("scan_below", n, nullptr, found, [] {
+			float sum = 0;
+			for (auto sit = ECS::System::range<const Tracked_health, const Position>(); sit; sit.advance()) {
+				if (sit.get<const Tracked_health>().hp < 10) {
+					sum += sit.get<const Position>().x;
+				}
+			}
+			sink = sum;
+		});
+		measure_once("index_build", n, nullptr, n, [] { ECS::System::add_index<&Tracked_health::hp>(); });
+		auto &index = ECS::System::get_index<&Tracked_health::hp>();
+		measure("index_below", n, nullptr, found, [&index] {
+			const auto weak = index.below(10);
+			float sum = 0;
+			for (auto sit = ECS::System::range<const Tracked_health, const Position>(weak); sit; sit.advance()) {
+				sum += sit.get<const Position>().x;
+			}
+			sink = sum;
+		});
+		//every 100th entity changes its hp, the next lookup applies the changes
+		int round = 0;
+		measure("index_update", n, nullptr, found, [&] {
+			round++;
+			for (std::size_t i = 0; i < n; i += 100) {
+				entities[i].modify<Tracked_health>()->hp = static_cast<int>((i + round) % 1000);
+			}
+			index.update();
+		});
+		destroy_all(entities);
+		index.update();
+	}
+
+	void benchmark_layout(std::size_t n) {
+		auto aos = ECS::Entity::create(n, Aos_particle{1000, 0, 0, 0, 1, 1, 1, 1});
+		auto soa = ECS::Entity::create(n, Soa_particle{1000, 0, 0, 0, 1, 1, 1, 1});
+		measure("field_update_aos", n, nullptr, n, [] {
+			for (auto &particle : ECS::System::get_components<Aos_particle>()) {
+				particle.life_time--;
+			}
+		});
+		measure("field_update_soa", n, nullptr, n, [] { ECS::System::for_each_column<&Soa_particle::life_time>([](int &life_time) { life_time--; }); });
+		measure("multi_field_update_aos", n, nullptr, n, [] {
+			for (auto &particle : ECS::System::get_components<Aos_particle>()) {
+				particle.x += particle.vx;
+				particle.y += particle.vy;
+				particle.z += particle.vz;
+			}
+		});
+		measure("multi_field_update_soa", n, nullptr, n, [] {
+			ECS::System::for_each_column<&Soa_particle::x, &Soa_particle::y, &Soa_particle::z, &Soa_particle::vx, &Soa_particle::vy, &Soa_particle::vz>(
+				[](float &x, float &y, float &z, float vx, float vy, float vz) {
+					x += vx;
+					y += vy;
+					z += vz;
+				});
+		});
+		destroy_all(aos);
+		destroy_all(soa);
+	}
+
+	//entities expire spread over 256 frames after 1000 idle frames
+	void benchmark_expiry(std::size_t n) {
+		constexpr std::size_t idle_frames = 1000;
+		std::mt19937_64 rng(42);
+		auto entities = ECS::Entity::create(n, Position{1, 2});
+		for (auto &entity : entities) {
+			std::move(entity).expire_after(idle_frames + rng() % 256);
+		}
+		measure_once("expiry_idle_frame", n, nullptr, idle_frames - 1, [] {
+			for (std::size_t frame = 1; frame < idle_frames; frame++) {
+				ECS::Expiry::end_frame();
+			}
+		});
+		measure_once("expiry_expire", n, nullptr, n, [] {
+			while (ECS::Expiry::size() != 0) {
+				ECS::Expiry::end_frame();
+			}
+		});
+	}
+
+	void benchmark_snapshot(std::size_t n) {
+		const auto path = (std::filesystem::temp_directory_path() / "ecs_benchmark.snapshot").string();
+		auto entities = ECS::Entity::create(n, Position{1, 2}, Velocity{3, 4});
+		measure_once("snapshot_save", n, nullptr, 2 * n, [&] { ECS::Snapshot::save(path.c_str()); });
+		destroy_all(entities);
+		measure_once("snapshot_load", n, nullptr, 2 * n, [&] { ECS::Snapshot::load(path.c_str(), entities); });
+		destroy_all(entities);
+		std::filesystem::remove(path);
+	}
+
+	//every 100th entity changes between two deltas and is found again by iterating with a Changed filter, applying a delta to the world it came from overwrites the components with the same values
+	void benchmark_delta(std::size_t n) {
+		auto entities = ECS::Entity::create(n, Tracked_position{1, 2});
+		std::string delta;
+		ECS::Changes::Tick_t since = 0;
+		measure_once("delta_full", n, nullptr, n, [&] {
+			std::ostringstream output;
+			since = ECS::Snapshot::write_delta(output, since);
+			delta = output.str();
+		});
+		const auto changed = (n + 99) / 100;
+		measure_once("delta_modify", n, nullptr, changed, [&] {
+			for (std::size_t i = 0; i < n; i += 100) {
+				entities[i].modify<Tracked_position>()->x++;
+			}
+		});
+		measure_once("iterate_changed", n, nullptr, changed, [since] {
+			float sum = 0;
+			for (auto sit = ECS::System::range<ECS::Changed<const Tracked_position>>(since); sit; sit.advance()) {
+				sum += sit.get<Tracked_position>().x;
+			}
+			sink = sum;
+		});
+		measure_once("delta_changes", n, nullptr, changed, [&] {
+			std::ostringstream output;
+			since = ECS::Snapshot::write_delta(output, since);
+			delta = output.str();
+		});
+		measure_once("delta_apply", n, nullptr, changed, [&] { ECS::Snapshot::apply_delta(delta.data(), delta.size()); });
+		destroy_all(entities);
+		ECS::Snapshot::forget_changes(ECS::Changes::current_tick());
+	}
+
+	void write_json(std::ostream &output, std::size_t max_entities) {
+		output << "{\n\t\"context\": {\"max_entities\": " << max_entities << ", \"assertions\": "
+#ifdef NDEBUG
+			   << "false"
+#else
+			   << "true"
+#endif
+			   << "},\n\t\"benchmarks\": [";
+		for (std::size_t i = 0; i < results.size(); i++) {
+			const auto &result = results[i];
+			const auto ns = result.seconds * 1e9;
+			output << (i == 0 ? "\n" : ",\n") << "\t\t{\"name\": \"" << result.name << "\", \"entities\": " << result.entities << ", \"overlap\": ";
+			if (result.overlap) {
+				output << '"' << result.overlap << '"';
+			} else {
+				output << "null";
+			}
+			output << ", \"operations\": " << result.operations << ", \"ns\": " << ns
+				   << ", \"ns_per_op\": " << (result.operations ? ns / result.operations : 0)
+				   << ", \"ns_per_entity\": " << (result.entities ? ns / result.entities : 0) << "}";
+		}
+		output << "\n\t]\n}\n";
+	}
+} // namespace
+
+int main(int argc, char *argv[]) {
+	std::size_t min_entities = 1000;
+	std::size_t max_entities = 10000000;
+	const char *output_file = nullptr;
+	for (int i = 1; i < argc; i++) {
+		if (i + 1 < argc && std::strcmp(argv[i], "--min-entities") == 0) {
+			min_entities = std::strtoull(argv[++i], nullptr, 10);
+		} else if (i + 1 < argc && std::strcmp(argv[i], "--max-entities") == 0) {
+			max_entities = std::strtoull(argv[++i], nullptr, 10);
+		} else if (i + 1 < argc && std::strcmp(argv[i], "--output") == 0) {
+			output_file = argv[++i];
+		} else {
+			std::cerr << "Usage: " << argv[0] << " [--min-entities N] [--max-entities N] [--output file.json]\n";
+			return 1;
+		}
+	}
+
+	ECS::Snapshot::register_component<Position>();
+	ECS::Snapshot::register_component<Velocity>();
+	ECS::Snapshot::register_component<Tracked_position>();
+	ECS::System::add_system<Position, const Velocity>([](ECS::Entity_handle entity) { entity.get<Position>()->x += entity.get<Velocity>()->dx; });
+	ECS::System::add_system<const Position, Health>([](ECS::Entity_handle entity) { entity.get<Health>()->hp -= entity.get<Position>()->x > 0; });
+	for (auto n = std::max<std::size_t>(min_entities, 1); n <= max_entities; n *= 10) {
+		std::cerr << "benchmarking " << n << " entities\n";
+		benchmark_storage(n);
+		benchmark_iteration(n, false);
+		benchmark_iteration(n, true);
+		benchmark_tags(n);
+		benchmark_index(n);
+		benchmark_layout(n);
+		benchmark_expiry(n);
+		benchmark_snapshot(n);
+		benchmark_delta(n);
+	}
+
+	if (output_file) {
+		std::ofstream output(output_file);
+		write_json(output, max_entities);
+	} else {
+		write_json(std::cout, max_entities);
+	}
+	ECS::Entity::clear_all();
+}
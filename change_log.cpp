@@ -0,0 +1,12 @@
+#include "change_log.h"
+#include "world.h"
+
+#include <atomic>
+
+ECS::Changes::Tick_t ECS::Changes::current_tick() {
+	return World::current().tick.load(std::memory_order_relaxed);
+}
+
+ECS::Changes::Tick_t ECS::Changes::advance_tick() {
+	return World::current().tick.fetch_add(1, std::memory_order_relaxed) + 1;
+}
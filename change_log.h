@@ -0,0 +1,228 @@
+#ifndef CHANGE_LOG_H
+#define CHANGE_LOG_H
+
+#include "ecs_impl.h"
+#include "utility/asserts.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+namespace ECS {
+	namespace Changes {
+		using Tick_t = std::uint64_t;
+		//changes are stamped with the current tick. It starts at 1, System::run_systems advances it at the end of every frame, systems with filters such
+		//as Changed<HP> when they start, Snapshot::write_delta after writing a delta and indexes when they are updated, see index.h. 64 bits don't wrap
+		//around. Every World has its own tick.
+		Tick_t current_tick();
+		//returns the new tick, safe to call from parallel systems
+		Tick_t advance_tick();
+	} // namespace Changes
+
+	namespace Impl {
+		/*
+		Remembers when components of one type were added, changed and removed, for pools whose Storage_policy sets track_changes.
+		Additions and changes are stamped per entity index in pages of 4096 indexes, every page and every block of 64 indexes keeps the newest tick
+		written into it. Collecting the changes since a tick only visits blocks that changed since then, so the cost grows with the number of changes and
+		not with the number of components. Changing components of different entities from parallel system chunks is safe.
+		Removals are kept in a log until they are forgotten.
+		*/
+		struct Change_log {
+			using Tick_t = Changes::Tick_t;
+
+			void added(Id_t id) {
+				const auto tick = Changes::current_tick();
+				const auto index = id_index(id);
+				auto &page = get_page(index);
+				const auto i = index & page_mask;
+				page.ids[i] = id;
+				page.added_ticks[i] = tick;
+				page.changed_ticks[i] = tick;
+				page.block_ticks[i >> block_bits].store(tick, std::memory_order_relaxed);
+				page.tick.store(tick, std::memory_order_relaxed);
+			}
+			void changed(Id_t id) {
+				const auto tick = Changes::current_tick();
+				const auto index = id_index(id);
+				auto &page = *pages[index >> page_bits];
+				const auto i = index & page_mask;
+				assert_fast(page.ids[i] == id); //only components that exist can change
+				if (page.changed_ticks[i] == tick) {
+					return;
+				}
+				page.changed_ticks[i] = tick;
+				page.block_ticks[i >> block_bits].store(tick, std::memory_order_relaxed);
+				page.tick.store(tick, std::memory_order_relaxed);
+			}
+			void removed(Id_t id) {
+				removals.push_back({Changes::current_tick(), id});
+			}
+			//call f(id, added) for every entity whose component was added or changed at or after since, in no particular order. added is true if the
+			//component was added at or after since. The component may have been removed again.
+			template <class Function>
+			void for_each_change(Tick_t since, Function &&f) const {
+				for (const auto &page : pages) {
+					if (!page || page->tick.load(std::memory_order_relaxed) < since) {
+						continue;
+					}
+					for (std::size_t block = 0; block < blocks_per_page; block++) {
+						if (page->block_ticks[block].load(std::memory_order_relaxed) < since) {
+							continue;
+						}
+						for (std::size_t i = block << block_bits; i < (block + 1) << block_bits; i++) {
+							if (page->changed_ticks[i] >= since) {
+								f(page->ids[i], page->added_ticks[i] >= since);
+							}
+						}
+					}
+				}
+			}
+			//id if the component of id was changed, or added if only_added is set, at or after since. Otherwise the smallest id with a later index whose
+			//component may qualify, max_id if there is none. Pages and blocks without changes are jumped over, so iterations in id order only look at the
+			//ticks of blocks that changed.
+			Id_t next_change(Id_t id, Tick_t since, bool only_added) const {
+				std::size_t index = id_index(id);
+				if (const auto page = changed_page(index, since)) {
+					const auto i = index & page_mask;
+					if (page->ids[i] == id && (only_added ? page->added_ticks : page->changed_ticks)[i] >= since) {
+						return id;
+					}
+				}
+				for (index++; index < pages.size() << page_bits;) {
+					const auto page = changed_page(index, since);
+					if (!page) {
+						index = (index | page_mask) + 1;
+						continue;
+					}
+					const auto block = (index & page_mask) >> block_bits;
+					if (page->block_ticks[block].load(std::memory_order_relaxed) >= since) {
+						const auto &ticks = only_added ? page->added_ticks : page->changed_ticks;
+						for (auto i = index & page_mask; i < (block + 1) << block_bits; i++) {
+							if (ticks[i] >= since) {
+								index = (index & ~page_mask) | i;
+								return index >= max_index ? max_id : make_id(static_cast<Index_t>(index), 0);
+							}
+						}
+					}
+					index = (index | block_mask) + 1;
+				}
+				return max_id;
+			}
+			//call f(id) for every removal at or after since, in the order of the removals
+			template <class Function>
+			void for_each_removal(Tick_t since, Function &&f) const {
+				for (auto it = std::lower_bound(begin(removals), end(removals), since, [](const Removal &removal, Tick_t tick) { return removal.tick < tick; });
+					 it != end(removals); ++it) {
+					f(it->id);
+				}
+			}
+			//drop removals before tick, they can no longer be collected
+			void forget_removals(Tick_t tick) {
+				const auto kept = std::lower_bound(begin(removals), end(removals), tick, [](const Removal &removal, Tick_t t) { return removal.tick < t; });
+				if (kept != begin(removals)) {
+					forgotten_tick = std::max(forgotten_tick, std::prev(kept)->tick + 1);
+				}
+				removals.erase(begin(removals), kept);
+			}
+			//for_each_removal misses removals if since is before this tick, because they were forgotten
+			Tick_t get_forgotten_tick() const {
+				return forgotten_tick;
+			}
+
+			private:
+			static constexpr unsigned page_bits = 12;
+			static constexpr unsigned block_bits = 6;
+			static constexpr std::size_t page_size = std::size_t{1} << page_bits;
+			static constexpr std::size_t page_mask = page_size - 1;
+			static constexpr std::size_t blocks_per_page = page_size >> block_bits;
+			static constexpr std::size_t block_mask = (std::size_t{1} << block_bits) - 1;
+			//the stamp of index i is ids[i], added_ticks[i] and changed_ticks[i], the ticks are separate so searching for changes only reads ticks
+			struct Page {
+				//newest tick of all stamps in the page and in each block
+				std::atomic<Tick_t> tick{0};
+				std::array<std::atomic<Tick_t>, blocks_per_page> block_ticks{};
+				std::array<Tick_t, page_size> changed_ticks{};
+				std::array<Tick_t, page_size> added_ticks{};
+				std::array<Id_t, page_size> ids;
+			};
+			struct Removal {
+				Tick_t tick;
+				Id_t id;
+			};
+			Page &get_page(Index_t index) {
+				const auto page_index = index >> page_bits;
+				if (page_index >= pages.size()) {
+					pages.resize(page_index + 1);
+				}
+				if (!pages[page_index]) {
+					pages[page_index] = std::make_unique<Page>();
+					pages[page_index]->ids.fill(max_id);
+				}
+				return *pages[page_index];
+			}
+			//the page of index if it changed at or after since
+			const Page *changed_page(std::size_t index, Tick_t since) const {
+				const auto page_index = index >> page_bits;
+				const Page *page = page_index < pages.size() ? pages[page_index].get() : nullptr;
+				return page && page->tick.load(std::memory_order_relaxed) >= since ? page : nullptr;
+			}
+
+			std::vector<std::unique_ptr<Page>> pages;
+			//ordered by tick
+			std::vector<Removal> removals;
+			Tick_t forgotten_tick = 0;
+		};
+
+		//components of one type that were added and removed since observers were last notified, see System::on_add. Only recorded while the type has
+		//observers, so pools of types without observers pay one branch per add and remove.
+		struct Pool_events {
+			void added(Id_t id) {
+				if (observed) {
+					events.push_back({id, true});
+				}
+			}
+			void removed(Id_t id) {
+				if (observed) {
+					events.push_back({id, false});
+				}
+			}
+			//move the net result of the events to added_ids and removed_ids, both sorted by id. exists(id) tells if the component of id exists now.
+			//Components that were added and removed again are in neither, components that were removed and added again are in both.
+			template <class Exists>
+			void take(Exists &&exists, std::vector<Id_t> &added_ids, std::vector<Id_t> &removed_ids) {
+				std::stable_sort(begin(events), end(events), [](const Event &lhs, const Event &rhs) { return lhs.id < rhs.id; });
+				for (std::size_t first = 0; first < events.size();) {
+					const auto id = events[first].id;
+					//the first event of an entity tells if it had the component before
+					if (!events[first].added) {
+						removed_ids.push_back(id);
+					}
+					if (exists(id)) {
+						added_ids.push_back(id);
+					}
+					while (first < events.size() && events[first].id == id) {
+						first++;
+					}
+				}
+				events.clear();
+			}
+
+			bool observed = false;
+
+			private:
+			struct Event {
+				Id_t id;
+				bool added;
+			};
+			//in the order they happened
+			std::vector<Event> events;
+		};
+	} // namespace Impl
+} // namespace ECS
+
+#endif // CHANGE_LOG_H
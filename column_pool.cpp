@@ -0,0 +1 @@
+#include "column_pool.h"
@@ -0,0 +1,278 @@
+#ifndef COLUMN_POOL_H
+#define COLUMN_POOL_H
+
+#include "change_log.h"
+#include "ecs_impl.h"
+#include "pool.h"
+#include "sparse_index.h"
+#include "utility.h"
+#include "utility/asserts.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ECS {
+	namespace Impl {
+		template <class Component>
+		struct Pool<Component, Column_storage>;
+	}
+	//refers to the fields of a component stored in columns. Like a pointer it becomes invalid when components of the same type are added or removed.
+	template <class Component>
+	struct Column_reference {
+		//false if the entity has no such component
+		explicit operator bool() const {
+			return pool != nullptr;
+		}
+		//the field of the component, for example get<&HP::hp>()
+		template <auto field>
+		auto &get() const {
+			return pool->template column<field>()[slot];
+		}
+		//copy the fields into a component
+		Component load() const {
+			return pool->load(slot);
+		}
+		//copy all fields of component into the columns
+		void store(const Component &component) const {
+			pool->store(slot, component);
+		}
+
+		Impl::Pool<Component, Column_storage> *pool;
+		std::size_t slot;
+	};
+
+	namespace Impl {
+		/*
+		Structure of arrays storage for components that are only accessed through some of their fields.
+		Every field listed in Storage_policy<Component>::columns lives in its own vector that is aligned to cache lines, so loops over a single field only
+		load that field and can be vectorized. Ids are sorted like with Sorted_storage, so joins work the same way.
+		Components are taken apart when they are added and only put together again by Column_reference::load, which requires Component to be default
+		constructible or an aggregate of the columns in declaration order.
+		*/
+		template <class Component>
+		struct Pool<Component, Column_storage> {
+			static constexpr std::size_t npos = -1;
+			static constexpr bool sparse = false;
+			static constexpr std::size_t column_alignment = 64;
+			static constexpr auto fields = Storage_policy<Component>::columns;
+			static constexpr std::size_t column_count = std::tuple_size<std::remove_cv_t<decltype(fields)>>::value;
+			template <std::size_t index>
+			using Field_type = typename Utility::Member_pointer_traits<std::remove_cv_t<std::tuple_element_t<index, std::remove_cv_t<decltype(fields)>>>>::Member;
+			template <class T>
+			using Column = std::vector<T, Utility::Aligned_allocator<T, column_alignment>>;
+
+			//ids has an extra max_id at the end so iterators can stop without checking the size
+			std::vector<Id_t> ids{max_id};
+			//maps ids to the position they had in ids and the columns when they were added, see Pool<Component, Sorted_storage>::slots
+			Sparse_index slots;
+			//only used if tracks_changes<Component>
+			Change_log changes;
+			//only used while the type has observers
+			Pool_events events;
+
+			std::size_t size() const {
+				return ids.size() - 1;
+			}
+			//make room for capacity components so adding components does not reallocate until the pool is bigger
+			void reserve(std::size_t capacity) {
+				for_each_column([capacity](auto, auto &field_column) { field_column.reserve(capacity); });
+				ids.reserve(capacity + 1);
+			}
+			//free memory that is not used by the current components
+			void shrink() {
+				for_each_column([](auto, auto &field_column) { field_column.shrink_to_fit(); });
+				ids.shrink_to_fit();
+			}
+			//the column of one field, for example column<&HP::hp>()
+			template <auto field>
+			Utility::Span<typename Utility::Member_pointer_traits<decltype(field)>::Member> column() {
+				auto &field_column = std::get<field_index<field>()>(columns);
+				return {field_column.data(), field_column.size()};
+			}
+			template <class... Args>
+			Column_reference<Component> emplace(Id_t id, Args &&... args) {
+				auto insert_position = std::lower_bound(begin(ids), end(ids), id);
+				assert_fast(*insert_position != id); //disallow multiple components of the same type for the same entity
+				const std::size_t slot = insert_position - begin(ids);
+				const auto component = make_component(std::forward<Args>(args)...);
+				for_each_column([&](auto index, auto &field_column) { field_column.insert(begin(field_column) + slot, component.*std::get<index>(fields)); });
+				ids.insert(insert_position, id);
+				slots.set(id, static_cast<Sparse_index::Slot_t>(slot));
+				record_added(id);
+				assert_all(std::is_sorted(begin(ids), end(ids)));
+				return {this, slot};
+			}
+			void erase(Id_t id) {
+				const auto slot = find(id);
+				assert_fast(slot != npos); //make sure the component to remove exists
+				for_each_column([&](auto, auto &field_column) { field_column.erase(begin(field_column) + slot); });
+				ids.erase(begin(ids) + slot);
+				slots.erase(id);
+				record_removed(id);
+			}
+			template <class Make>
+			void append(const Id_t *new_ids, std::size_t count, Make &&make) {
+				if (count == 0) {
+					return;
+				}
+				if (size() != 0 && ids[size() - 1] >= new_ids[0]) { //cannot append, merge
+					std::vector<std::pair<Id_t, Component>> entries;
+					entries.reserve(count);
+					for (std::size_t i = 0; i < count; i++) {
+						entries.emplace_back(new_ids[i], make(i));
+					}
+					insert_sorted(entries);
+					return;
+				}
+				for_each_column([&](auto, auto &field_column) { field_column.reserve(size() + count); });
+				ids.reserve(size() + count + 1);
+				ids.pop_back();
+				for (std::size_t i = 0; i < count; i++) {
+					const Component &component = make(i);
+					for_each_column([&](auto index, auto &field_column) { field_column.push_back(component.*std::get<index>(fields)); });
+					ids.push_back(new_ids[i]);
+					slots.set(new_ids[i], static_cast<Sparse_index::Slot_t>(ids.size() - 1));
+					record_added(new_ids[i]);
+				}
+				ids.push_back(max_id);
+			}
+			void erase_sorted(const Id_t *erase_ids, std::size_t count) {
+				if (count == 0) {
+					return;
+				}
+				const auto old_size = size();
+				auto write = static_cast<std::size_t>(std::lower_bound(begin(ids), end(ids), erase_ids[0]) - begin(ids));
+				std::size_t next_erase = 0;
+				for (auto read = write; read < old_size; read++) {
+					if (next_erase < count && ids[read] == erase_ids[next_erase]) {
+						slots.erase(ids[read]);
+						record_removed(ids[read]);
+						next_erase++;
+						continue;
+					}
+					if (write != read) {
+						ids[write] = ids[read];
+						for_each_column([&](auto, auto &field_column) { field_column[write] = field_column[read]; });
+					}
+					write++;
+				}
+				assert_fast(next_erase == count); //make sure all components to remove existed
+				for_each_column([&](auto, auto &field_column) { field_column.resize(write); });
+				ids.erase(begin(ids) + write, end(ids) - 1);
+			}
+			void insert_sorted(std::vector<std::pair<Id_t, Component>> &entries) {
+				if (entries.empty()) {
+					return;
+				}
+				const std::size_t old_size = size();
+				const auto new_size = old_size + entries.size();
+				//merge from the back so every element is moved at most once
+				ids.resize(new_size + 1);
+				ids[new_size] = max_id;
+				for_each_column([&](auto, auto &field_column) { field_column.resize(new_size); });
+				auto old_slot = old_size;
+				auto entry = entries.size();
+				auto write = new_size;
+				while (entry > 0) {
+					write--;
+					if (old_slot > 0 && ids[old_slot - 1] > entries[entry - 1].first) {
+						old_slot--;
+						ids[write] = ids[old_slot];
+						for_each_column([&](auto, auto &field_column) { field_column[write] = field_column[old_slot]; });
+					} else {
+						entry--;
+						assert_fast(old_slot == 0 || ids[old_slot - 1] != entries[entry].first); //disallow multiple components of the same type
+						ids[write] = entries[entry].first;
+						store(write, entries[entry].second);
+						slots.set(ids[write], static_cast<Sparse_index::Slot_t>(write));
+						record_added(ids[write]);
+					}
+				}
+				assert_all(std::is_sorted(begin(ids), end(ids)));
+			}
+			std::size_t find(Id_t id) const {
+				const auto hint = slots.get(id);
+				if (hint == Sparse_index::npos) {
+					return npos;
+				}
+				const auto slot = gallop_from_hint(ids, hint, id);
+				return ids[slot] != id ? npos : slot;
+			}
+			Component load(std::size_t slot) const {
+				return make_from_fields([this, slot](auto index) -> decltype(auto) { return std::get<index>(columns)[slot]; });
+			}
+			void store(std::size_t slot, const Component &component) {
+				for_each_column([&](auto index, auto &field_column) { field_column[slot] = component.*std::get<index>(fields); });
+			}
+			//put a component together from its fields, field(std::integral_constant<std::size_t, i>) returns the value of the i-th column
+			template <class Function>
+			static Component make_from_fields(Function &&field) {
+				return make_from_fields(field, std::make_index_sequence<column_count>{});
+			}
+			//call f(std::integral_constant<std::size_t, i>, column) for every column
+			template <class Function>
+			void for_each_column(Function &&f) {
+				for_each_column(std::forward<Function>(f), std::make_index_sequence<column_count>{});
+			}
+
+			private:
+			void record_added(Id_t id) {
+				events.added(id);
+				if constexpr (tracks_changes<Component>) {
+					changes.added(id);
+				}
+			}
+			void record_removed(Id_t id) {
+				events.removed(id);
+				if constexpr (tracks_changes<Component>) {
+					changes.removed(id);
+				}
+			}
+			template <std::size_t... indexes>
+			static std::tuple<Column<Field_type<indexes>>...> make_columns(std::index_sequence<indexes...>);
+			decltype(make_columns(std::make_index_sequence<column_count>{})) columns;
+
+			template <auto field, std::size_t index = 0>
+			static constexpr std::size_t field_index() {
+				static_assert(index < column_count, "The field is not one of the columns of the component");
+				if constexpr (std::is_same<decltype(field), std::remove_cv_t<std::tuple_element_t<index, std::remove_cv_t<decltype(fields)>>>>::value) {
+					if (std::get<index>(fields) == field) {
+						return index;
+					}
+				}
+				if constexpr (index + 1 < column_count) {
+					return field_index<field, index + 1>();
+				}
+				return column_count;
+			}
+			template <class Function, std::size_t... indexes>
+			void for_each_column(Function &&f, std::index_sequence<indexes...>) {
+				(f(std::integral_constant<std::size_t, indexes>{}, std::get<indexes>(columns)), ...);
+			}
+			template <class... Args>
+			static Component make_component(Args &&... args) {
+				if constexpr (std::is_pod<Component>::value) {
+					return Component{std::forward<Args>(args)...};
+				} else {
+					return Component(std::forward<Args>(args)...);
+				}
+			}
+			template <class Function, std::size_t... indexes>
+			static Component make_from_fields(Function &field, std::index_sequence<indexes...>) {
+				if constexpr (std::is_default_constructible<Component>::value) {
+					Component component{};
+					((component.*std::get<indexes>(fields) = field(std::integral_constant<std::size_t, indexes>{})), ...);
+					return component;
+				} else {
+					return Component{field(std::integral_constant<std::size_t, indexes>{})...};
+				}
+			}
+		};
+	} // namespace Impl
+} // namespace ECS
+
+#endif // COLUMN_POOL_H
@@ -0,0 +1,37 @@
+#include "command_buffer.h"
+#include "trace.h"
+
+void ECS::Command_buffer::append(Command_buffer &&other) {
+	for (auto &other_queue : other.queues) {
+		if (other_queue.changes->empty()) {
+			continue;
+		}
+		auto pos = std::find_if(begin(queues), end(queues), [&other_queue](const Queue &queue) { return queue.type == other_queue.type; });
+		if (pos == end(queues)) {
+			queues.push_back({other_queue.type, other_queue.changes->make_empty()});
+			pos = end(queues) - 1;
+		}
+		pos->changes->take(*other_queue.changes);
+	}
+	std::move(begin(other.destroyed), end(other.destroyed), std::back_inserter(destroyed));
+	other.destroyed.clear();
+}
+
+void ECS::Command_buffer::flush() {
+	TRACE("flush", queues.size(), destroyed.size());
+	//applying changes may create new queues if components are added from destructors, so don't hold iterators
+	for (std::size_t i = 0; i < queues.size(); i++) {
+		queues[i].changes->apply();
+	}
+	if (destroyed.empty()) {
+		return;
+	}
+	std::vector<Impl::Id_t> destroyed_ids;
+	destroyed_ids.reserve(destroyed.size());
+	for (auto &entity : destroyed) {
+		destroyed_ids.push_back(entity.to_handle().id);
+	}
+	std::sort(begin(destroyed_ids), end(destroyed_ids));
+	Impl::Entity_base::remove_all_components(destroyed_ids);
+	destroyed.clear();
+}
@@ -0,0 +1,138 @@
+#ifndef COMMAND_BUFFER_H
+#define COMMAND_BUFFER_H
+
+#include "entity.h"
+#include "entity_handle.h"
+#include "system_base.h"
+#include "utility/asserts.h"
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace ECS {
+	/*
+	Records adding and removing components and destroying entities and applies them later in flush.
+	Changing components while iterating over them invalidates the iterators, recording the changes and flushing them after the iteration is safe.
+	flush sorts the changes per component type and applies them with one pass over each pool, so k changes to a pool of n components cost
+	O(n + k log k) instead of O(n * k).
+	Per component type, removals are applied before additions. Entities are destroyed after all components have been added and removed.
+	Changes to entities that were destroyed after the change was recorded, for example by another system of the same frame, are dropped on flush.
+	*/
+	struct Command_buffer {
+		Command_buffer() = default;
+		Command_buffer(Command_buffer &&) = default;
+		Command_buffer &operator=(Command_buffer &&) = default;
+		//nothing is added if the entity was destroyed before the buffer is flushed
+		template <class Component, class... Args>
+		void emplace(Entity_handle entity, Args &&... args) {
+			assert_fast(entity);
+			record_emplace<Component>(entity.id, std::forward<Args>(args)...);
+		}
+		template <class Component>
+		void add(Entity_handle entity, Component &&c) {
+			emplace<Utility::remove_cvr<Component>>(entity, std::forward<Component>(c));
+		}
+		//UB if the entity is alive but has no such component when the buffer is flushed
+		template <class Component>
+		void remove(Entity_handle entity) {
+			assert_fast(entity);
+			get_queue<Component>().removals.push_back(entity.id);
+		}
+		//takes ownership of the entity and destroys it on flush
+		void destroy(Entity &&entity) {
+			destroyed.push_back(std::move(entity));
+		}
+		//move the changes recorded in other into this buffer
+		void append(Command_buffer &&other);
+		//apply all recorded changes
+		void flush();
+		bool empty() const {
+			return destroyed.empty() && std::all_of(begin(queues), end(queues), [](const Queue &queue) { return queue.changes->empty(); });
+		}
+
+		private:
+		struct Changes_base {
+			virtual ~Changes_base() = default;
+			virtual void apply() = 0;
+			virtual bool empty() const = 0;
+			//move the changes of other, which must have the same component type, to this
+			virtual void take(Changes_base &other) = 0;
+			virtual std::unique_ptr<Changes_base> make_empty() const = 0;
+		};
+		template <class Component>
+		struct Changes : Changes_base {
+			std::vector<std::pair<Impl::Id_t, Component>> additions;
+			std::vector<Impl::Id_t> removals;
+
+			void apply() override {
+				//destroying an entity removed its components, adding components under its id would revive it in the pools and signatures
+				const auto dead = [](Impl::Id_t id) { return !Impl::Entity_base::is_alive(id); };
+				removals.erase(std::remove_if(begin(removals), end(removals), dead), end(removals));
+				additions.erase(std::remove_if(begin(additions), end(additions), [&dead](const auto &addition) { return dead(addition.first); }),
+								end(additions));
+				if (!removals.empty()) {
+					std::sort(begin(removals), end(removals));
+					Impl::Entity_base::remove_from_signatures<Component>(removals);
+					System::get_pool<Component>().erase_sorted(removals.data(), removals.size());
+					removals.clear();
+				}
+				if (!additions.empty()) {
+					std::sort(begin(additions), end(additions), [](const auto &lhs, const auto &rhs) { return lhs.first < rhs.first; });
+					std::vector<Impl::Id_t> added_ids;
+					added_ids.reserve(additions.size());
+					for (const auto &addition : additions) {
+						added_ids.push_back(addition.first);
+					}
+					System::get_pool<Component>().insert_sorted(additions);
+					Impl::Entity_base::add_to_signatures<Component>(added_ids);
+					additions.clear();
+				}
+			}
+			bool empty() const override {
+				return additions.empty() && removals.empty();
+			}
+			void take(Changes_base &other) override {
+				auto &other_changes = static_cast<Changes &>(other);
+				std::move(begin(other_changes.additions), end(other_changes.additions), std::back_inserter(additions));
+				removals.insert(end(removals), begin(other_changes.removals), end(other_changes.removals));
+				other_changes.additions.clear();
+				other_changes.removals.clear();
+			}
+			std::unique_ptr<Changes_base> make_empty() const override {
+				return std::make_unique<Changes>();
+			}
+		};
+		struct Queue {
+			const void *type;
+			std::unique_ptr<Changes_base> changes;
+		};
+		//like emplace without checking the entity, which would read the generations of the world
+		template <class Component, class... Args>
+		void record_emplace(Impl::Id_t id, Args &&... args) {
+			auto &queue = get_queue<Component>();
+			if constexpr (std::is_pod<Component>::value) {
+				queue.additions.emplace_back(id, Component{std::forward<Args>(args)...});
+			} else {
+				queue.additions.emplace_back(std::piecewise_construct, std::forward_as_tuple(id), std::forward_as_tuple(std::forward<Args>(args)...));
+			}
+		}
+		template <class Component>
+		Changes<Component> &get_queue() {
+			auto pos = std::find_if(begin(queues), end(queues), [](const Queue &queue) { return queue.type == Impl::type_key<Component>(); });
+			if (pos == end(queues)) {
+				queues.push_back({Impl::type_key<Component>(), std::make_unique<Changes<Component>>()});
+				pos = end(queues) - 1;
+			}
+			return static_cast<Changes<Component> &>(*pos->changes);
+		}
+
+		std::vector<Queue> queues;
+		std::vector<Entity> destroyed;
+		friend struct Staging_buffer;
+	};
+} // namespace ECS
+
+#endif // COMMAND_BUFFER_H
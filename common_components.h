@@ -15,7 +15,7 @@ namespace Common_components {
 		int max_hp;
 	};
 	struct Life_time {
-		int life_time; //in logical frames left
+		int life_time; //in logical frames left, Entity::expire_after destroys entities after a number of frames without visiting them every frame
 	};
 	//Tags
 	struct Enemy {}; //set for all targetable enemies
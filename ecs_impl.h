@@ -1,13 +1,37 @@
 #ifndef ECS_IMPL_H
 #define ECS_IMPL_H
 
+#include <cstdint>
 #include <limits>
 
 namespace ECS {
 	//every Entity gets a unique Id
 	namespace Impl {
+		//The upper 32 bits of an Id are the index of the entity, the lower 32 bits its generation. Indexes of destroyed entities are reused with the next
+		//generation, so indexes stay as small as the number of live entities and can address arrays directly, while ids of destroyed entities never
+		//match a live entity. Ids are ordered by index first.
 		using Id_t = long long unsigned int;
+		using Index_t = std::uint32_t;
+		using Generation_t = std::uint32_t;
 		constexpr Id_t max_id = std::numeric_limits<Id_t>::max();
+		//the index of max_id, never used by an entity
+		constexpr Index_t max_index = std::numeric_limits<Index_t>::max();
+		constexpr Index_t id_index(Id_t id) {
+			return static_cast<Index_t>(id >> 32);
+		}
+		constexpr Generation_t id_generation(Id_t id) {
+			return static_cast<Generation_t>(id);
+		}
+		constexpr Id_t make_id(Index_t index, Generation_t generation) {
+			return Id_t{index} << 32 | generation;
+		}
+		//a unique address per type to tell types apart at runtime without RTTI
+		template <class T>
+		inline const char type_key_storage{};
+		template <class T>
+		constexpr const void *type_key() {
+			return &type_key_storage<T>;
+		}
 	} // namespace Impl
 } // namespace ECS
 
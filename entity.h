@@ -1,16 +1,21 @@
 #ifndef ENTITY_H
 #define ENTITY_H
 
-#include "ecs/system.h"
 #include "entity_base.h"
+#include "expiry.h"
+#include "system.h"
 #include "utility.h"
 #include "utility/asserts.h"
 
+#include <cstdint>
 #include <iostream>
+#include <iterator>
+#include <tuple>
+#include <vector>
 
 /*
 Overhead of the Entity Component System:
-	One Id per Entity and Component + 1 function pointer per Component
+	One Id per Entity and Component + a Signature with one bit per component type per Entity that has components
 	Components are stored in one vector per type
 	Ids are stored in one vector per component type
 	Putting components and Ids into the same vector would work, not sure if it would be better. Probably depends on component size.
@@ -20,43 +25,115 @@ namespace ECS {
 	struct Entity_handle;
 	//an Entity can have any type of component added to it
 	//note that you cannot add multiple components with the same type, use vector<component> or array<component> to get around that
+	//An Entity remembers the world it was created in and is destroyed there even if another world is current, so the world must outlive it.
 	struct Entity : private Impl::Entity_base {
 		Entity()
-			: Entity_base(++id_counter) {}
+			: Entity_base(create_id())
+			, owner(&World::current()) {}
 		Entity(Entity &&other) noexcept
-			: Entity_base(std::move(other)) {}
+			: Entity_base(std::move(other))
+			, owner(other.owner) {}
 		Entity &operator=(Entity &&other) noexcept {
 			std::swap(id, other.id);
+			std::swap(owner, other.owner);
 			return *this;
 		}
 
 		~Entity() {
-			assert_all(std::is_sorted(begin(removers), end(removers))); //make sure removers are still sorted
-			auto entity_range = std::equal_range(begin(removers), end(removers), id);
-			removers.erase(entity_range.first, entity_range.second);
-			assert_all(std::is_sorted(begin(removers), end(removers)));          //make sure removers are still sorted
-			assert_all(!std::binary_search(begin(removers), end(removers), id)); //make sure we deleted all removers with our id
+			if (is_valid()) {
+				const World::Scope scope(*owner);
+				remove_all_components(id);
+				destroy_id(id);
+			}
 		}
-		//clears all components from all entities
+		//create count entities that each get a copy of the given components
+		//ids, components and signatures are appended in one go instead of one emplace per entity and component
+		template <class... Components>
+		static std::vector<Entity> create(std::size_t count, const Components &... components) {
+			const auto ids = create_ids(count);
+			(System::get_pool<Components>().append(ids.data(), count, [&components](std::size_t) -> const Components & { return components; }), ...);
+			return make_entities<Components...>(ids);
+		}
+		//create one entity per element of the given columns, entity i gets the component columns[i] of each column. All columns must have the same size.
+		template <class... Columns>
+		static std::vector<Entity> create_from_columns(const Columns &... columns) {
+			const std::size_t count = std::size(std::get<0>(std::tie(columns...)));
+			assert_fast(((std::size(columns) == count) && ...));
+			const auto ids = create_ids(count);
+			(System::get_pool<Column_type<Columns>>().append(ids.data(), count, [&columns](std::size_t i) -> decltype(auto) { return std::data(columns)[i]; }),
+			 ...);
+			return make_entities<Column_type<Columns>...>(ids);
+		}
+		//clears all components from all entities of the current world
 		//must call this at the end of main before destructors of static Entities run, otherwise it may crash due to static initialization order fiasco
 		static void clear_all() {
-			removers.clear();
+			Expiry::clear();
+			remove_all_components();
 		}
 		//transfer ownership of this entity to the ECS. It is passed a function that takes an Entity& and returns a bool iff the entity should be destroyed now
+		//the function is called once per frame, see expiry.h
 		inline void make_automatic(bool (*function)(Entity_handle)) &&;
 		static void make_automatic(Entity &&entity, bool (*function)(Entity_handle)) {
 			std::move(entity).make_automatic(function);
 		}
+		//transfer ownership of this entity to the ECS, which destroys it at the end of the frames-th frame from now, see expiry.h
+		void expire_after(std::uint64_t frames) && {
+			Expiry::expire_after(std::move(*this), frames);
+		}
+		static void expire_after(Entity &&entity, std::uint64_t frames) {
+			std::move(entity).expire_after(frames);
+		}
 		//turn to handle
 		Entity_handle to_handle() {
 			return Entity_handle{id};
 		}
-		//inherit from Entity_base
-		using Entity_base::add;
-		using Entity_base::emplace;
-		using Entity_base::get;
+		//the functions of Entity_base, only usable while the world of the entity is current
+		template <class Component, class... Args>
+		decltype(auto) emplace(Args &&... args) {
+			assert_fast(owner == &World::current()); //the entity belongs to another world
+			return Entity_base::emplace<Component>(std::forward<Args>(args)...);
+		}
+		template <class Component>
+		decltype(auto) add(Component &&c) {
+			assert_fast(owner == &World::current()); //the entity belongs to another world
+			return Entity_base::add(std::forward<Component>(c));
+		}
+		template <class Component>
+		auto get() {
+			assert_fast(owner == &World::current()); //the entity belongs to another world
+			return Entity_base::get<Component>();
+		}
+		template <class Component>
+		auto modify() {
+			assert_fast(owner == &World::current()); //the entity belongs to another world
+			return Entity_base::modify<Component>();
+		}
+		template <class Component>
+		void remove() {
+			assert_fast(owner == &World::current()); //the entity belongs to another world
+			Entity_base::remove<Component>();
+		}
 		using Entity_base::is_valid;
-		using Entity_base::remove;
+
+		private:
+		friend struct Impl::Snapshot_access;
+		friend struct Staging_buffer;
+		explicit Entity(Impl::Id_t id)
+			: Entity_base(id)
+			, owner(&World::current()) {}
+		template <class Column>
+		using Column_type = Utility::remove_cvr<decltype(*std::data(std::declval<const Column &>()))>;
+		template <class... Components>
+		static std::vector<Entity> make_entities(const std::vector<Impl::Id_t> &ids) {
+			add_to_signatures<Components...>(ids.data(), ids.size());
+			std::vector<Entity> entities;
+			entities.reserve(ids.size());
+			for (auto id : ids) {
+				entities.push_back(Entity{id});
+			}
+			return entities;
+		}
+		World *owner;
 	};
 
 	struct Remove_checker {
@@ -88,7 +165,7 @@ namespace ECS {
 
 	void ECS::Entity::make_automatic(bool (*function)(Entity_handle)) && {
 		assert_fast(is_valid());
-		System::get_components<Remove_checker>().push_back(Remove_checker{function, std::move(*this)});
+		Expiry::add_checker(Remove_checker{function, std::move(*this)});
 	}
 } // namespace ECS
 
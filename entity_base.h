@@ -1,22 +1,28 @@
 #ifndef ENTITY_BASE_H
 #define ENTITY_BASE_H
 
-#include "ecs/log.h"
 #include "ecs_impl.h"
+#include "log.h"
+#include "signature.h"
 #include "system_base.h"
 #include "utility/asserts.h"
+#include "world.h"
 
 #include <algorithm>
-#include <tuple>
+#include <cstddef>
+#include <functional>
 #include <type_traits>
-#include <typeinfo>
+#include <utility>
 #include <vector>
 
 namespace ECS {
+	struct Command_buffer;
+	struct Staging_buffer;
 	//an Entity can have any type of component added to it
 	//note that you cannot add multiple components of the same type, use vector<component> or array<component> to get around that
 
 	namespace Impl {
+		struct Snapshot_access;
 		struct Entity_base {
 			Entity_base(Impl::Id_t id)
 				: id(id) {}
@@ -31,47 +37,59 @@ namespace ECS {
 			~Entity_base() = default;
 
 			//emplace a component into an Entity
+			//returns a reference to the component, or a Column_reference for components with Column_storage, or nothing for tags
 			template <class Component, class... Args>
-			Component &emplace(Args &&... args) {
-				auto &ids = System::get_ids<Component>();
-				auto &components = System::get_components<Component>();
-				auto insert_position = std::lower_bound(begin(ids), end(ids), id);
-				assert_fast(*insert_position != id); //disallow multiple components of the same type for the same entity
-				typename std::remove_reference_t<decltype(components)>::iterator inserted_component; //TODO: find a way to make this prettier
-				if constexpr (std::is_pod<Component>::value) {
-					inserted_component = components.insert(begin(components) + (insert_position - begin(ids)), Component{std::forward<Args>(args)...});
+			decltype(auto) emplace(Args &&... args) {
+				auto &owner = world();
+				if constexpr (Impl::is_tag_storage<Component>) {
+					owner.get_pool<Component>().emplace(id);
+					owner.signatures.get_or_add(id).set(type_index<Component>());
 				} else {
-					inserted_component = components.emplace(begin(components) + (insert_position - begin(ids)), std::forward<Args>(args)...);
+					decltype(auto) inserted_component = owner.get_pool<Component>().emplace(id, std::forward<Args>(args)...);
+					owner.signatures.get_or_add(id).set(type_index<Component>());
+					return inserted_component;
 				}
-				ids.insert(insert_position, id);
-				add_remover<Component>();
-				assert_all(std::is_sorted(begin(ids), end(ids)));
-				return *inserted_component;
 			}
 			//add a component to an Entity
 			template <class Component>
-			Component &add(Component &&c) {
+			decltype(auto) add(Component &&c) {
 				return emplace<Component>(std::forward<Component>(c));
 			}
 			//get the component of a given type or nullptr if the Entity has no such component
+			//components with Column_storage return a Column_reference that converts to false if the Entity has no such component
+			//tags return a pointer to an instance that all entities with the tag share
 			template <class Component>
-			Component *get() {
-				auto &ids = System::get_ids<Component>();
-				auto id_it = lower_bound(begin(ids), end(ids), id);
-				if (*id_it != id) {
-					return nullptr;
+			auto get() {
+				auto &pool = world().get_pool<Component>();
+				if constexpr (Impl::is_tag_storage<Component>) {
+					return pool.contains(id) && is_alive(id) ? &pool.instance : nullptr;
+				} else if constexpr (Impl::is_column_storage<Component>) {
+					const auto pos = pool.find(id);
+					return Column_reference<Component>{pos == pool.npos ? nullptr : &pool, pos};
+				} else {
+					const auto pos = pool.find(id);
+					return pos == pool.npos ? nullptr : &pool.components[pos];
+				}
+			}
+			//same as get, but the component is recorded as changed if its Storage_policy sets track_changes, see change_log.h
+			template <class Component>
+			auto modify() {
+				auto component = get<Component>();
+				if constexpr (Impl::tracks_changes<Component>) {
+					if (component) {
+						System::get_pool<Component>().changes.changed(id);
+					}
 				}
-				auto pos = id_it - begin(ids);
-				auto &components = System::get_components<Component>();
-				return &components.at(pos);
+				return component;
 			}
 			//remove a component of a given type, UB if the entity has no such component, test with get to check if the entity has that component
 			template <class Component>
 			void remove() {
-				auto &ids = System::get_ids<Component>();
-				auto id_pos = lower_bound(begin(ids), end(ids), id);
-				assert_fast(id_pos != end(ids));
-				remove_remover<Component>(id_pos - begin(ids));
+				auto &owner = world();
+				auto signature = owner.signatures.find(id);
+				assert_fast(signature && signature->test(type_index<Component>())); //make sure the entity has a component of that type
+				signature->reset(type_index<Component>());
+				owner.get_pool<Component>().erase(id);
 			}
 			//check if the entity is valid. An entity becomes invalid when it is moved from
 			bool is_valid() const {
@@ -79,88 +97,140 @@ namespace ECS {
 			}
 
 			private:
-			//remove a component of the given type and id
+			//dense index of a component type, the bit of the type in Signatures
 			template <class Component>
-			static void remover(Impl::Id_t id) {
-				auto &ids = System::get_ids<Component>();
-				auto id_it = lower_bound(begin(ids), end(ids), id);
-				assert_fast(*id_it == id); //make sure the component to remove exists
-				auto &components = System::get_components<Component>();
-				components.erase(begin(components) + (id_it - begin(ids)));
-				ids.erase(id_it);
-				assert_all(std::is_sorted(begin(ids), end(ids)));
+			static std::size_t type_index() {
+				return World::type_index<Component>();
 			}
 
-			template <class Component>
-			void add_remover() {
-				Remover r(id, remover<Component>, typeid(Component).name());
-				auto pos = std::lower_bound(begin(removers), end(removers), r);
-				removers.insert(pos, std::move(r));
-				assert_all(std::is_sorted(begin(removers), end(removers)));
+			protected:
+			//get an unused id, reusing the smallest index of a destroyed entity if possible.
+			//Taking the smallest index makes entities created one after another get increasing ids, which sorted pools can append without moving.
+			static Impl::Id_t create_id() {
+				auto &generations = world().generations;
+				auto &free_indexes = world().free_indexes;
+				if (!free_indexes.empty()) {
+					std::pop_heap(begin(free_indexes), end(free_indexes), std::greater<>{});
+					const auto index = free_indexes.back();
+					free_indexes.pop_back();
+					return make_id(index, generations[index]);
+				}
+				const auto index = reserve_index(world());
+				if (index >= generations.size()) {
+					//indexes in between are reserved by Staging_buffers and stay unused until they are merged
+					generations.resize(index + 1, 0);
+				}
+				return make_id(index, 0);
 			}
-
-			template <class Component>
-			void remove_remover(int index) {
-				removers.erase(begin(removers) + index);
+			//get an index of owner that no entity had before, safe to call from any thread.
+			//Only the caller knows about the index until it is in generations, see extend_generations.
+			static Impl::Index_t reserve_index(World &owner) {
+				const auto index = owner.next_index.fetch_add(1, std::memory_order_relaxed);
+				assert_fast(index < max_index); //out of indexes
+				return static_cast<Index_t>(index);
 			}
-
-			//a struct to remove a component. This is unfortunately necessary, because entities don't know the types of their components
-			struct Remover {
-				Remover(Impl::Id_t id, void (*f)(Impl::Id_t), const char *type_name)
-					: f(f)
-					, id(id)
-					, type_name(type_name) {
-					Log::log_debug() << "++++++++Create remover for Entity " << id << " Component " << Utility::type_name(type_name);
+			//make the ids with indexes below count known, for indexes from reserve_index or ids from another world
+			static void extend_generations(std::size_t count) {
+				auto &generations = world().generations;
+				if (generations.size() < count) {
+					generations.resize(count, 0);
 				}
-				Remover(Remover &&other) noexcept
-					: f(other.f)
-					, id(other.id)
-					, type_name(other.type_name) {
-					other.f = remover_dummy;
+				auto &next_index = world().next_index;
+				auto next = next_index.load(std::memory_order_relaxed);
+				while (next < count && !next_index.compare_exchange_weak(next, count, std::memory_order_relaxed)) {
 				}
-				Remover &operator=(Remover &&other) noexcept {
-					using std::swap;
-					swap(id, other.id);
-					swap(f, other.f);
-					swap(type_name, other.type_name);
-					return *this;
+			}
+			//get count unused ids in ascending order
+			static std::vector<Impl::Id_t> create_ids(std::size_t count) {
+				std::vector<Impl::Id_t> ids;
+				ids.reserve(count);
+				for (std::size_t i = 0; i < count; i++) {
+					ids.push_back(create_id());
 				}
-				~Remover() {
-					if (f != remover_dummy) {
-						Log::log_debug() << "--------------------Remove Entity " << id << " Component " << Utility::type_name(type_name);
-						f(id);
-					}
+				return ids;
+			}
+			//make the index of id available again, the next entity that gets it has a new generation
+			static void destroy_id(Impl::Id_t id) {
+				auto &generations = world().generations;
+				auto &free_indexes = world().free_indexes;
+				const auto index = id_index(id);
+				assert_fast(index < generations.size() && generations[index] == id_generation(id)); //make sure the entity has not been destroyed before
+				generations[index]++;
+				free_indexes.push_back(index);
+				std::push_heap(begin(free_indexes), end(free_indexes), std::greater<>{});
+			}
+			//true if id belongs to an entity that has not been destroyed
+			static bool is_alive(Impl::Id_t id) {
+				const auto &generations = world().generations;
+				const auto index = id_index(id);
+				return index < generations.size() && generations[index] == id_generation(id);
+			}
+			//add the components to the signatures of count entities with the given ids
+			template <class... Components>
+			static void add_to_signatures(const Impl::Id_t *ids, std::size_t count) {
+				Signature added;
+				(added.set(type_index<Components>()), ...);
+				auto &signatures = world().signatures;
+				signatures.reserve(signatures.get_ids().size() + count);
+				for (std::size_t i = 0; i < count; i++) {
+					signatures.get_or_add(ids[i]) |= added;
 				}
-				bool operator<(const Remover &other) const {
-					return std::tie(id, f) < std::tie(other.id, other.f);
+			}
+			//add the component type to the signatures of the entities with the given ids
+			template <class Component>
+			static void add_to_signatures(const std::vector<Impl::Id_t> &ids) {
+				const auto index = type_index<Component>();
+				auto &signatures = world().signatures;
+				for (auto id : ids) {
+					signatures.get_or_add(id).set(index);
 				}
-				bool operator<(Impl::Id_t other_id) const {
-					return id < other_id;
+			}
+			//remove the component type from the signatures of the entities with the given ids without removing the components
+			template <class Component>
+			static void remove_from_signatures(const std::vector<Impl::Id_t> &ids) {
+				const auto index = type_index<Component>();
+				auto &signatures = world().signatures;
+				for (auto id : ids) {
+					auto signature = signatures.find(id);
+					assert_fast(signature && signature->test(index)); //make sure the entity has a component of that type
+					signature->reset(index);
 				}
-				bool operator>(Impl::Id_t other_id) const {
-					return id > other_id;
+			}
+			//remove all components of one entity, costs one pool erase per component of the entity
+			static void remove_all_components(Impl::Id_t id) {
+				//take the signature first, destroying components may destroy other entities which changes the table
+				world().signatures.take(id).for_each([id](std::size_t index) { World::destroy_table[index](&id, 1); });
+			}
+			//remove all components of the entities with the given sorted ids, components of the same type are removed together
+			static void remove_all_components(const std::vector<Impl::Id_t> &sorted_ids) {
+				std::vector<std::vector<Impl::Id_t>> ids_per_type(World::component_type_count);
+				auto &signatures = world().signatures;
+				for (auto id : sorted_ids) {
+					signatures.take(id).for_each([&ids_per_type, id](std::size_t index) { ids_per_type[index].push_back(id); });
 				}
+				for (std::size_t index = 0; index < ids_per_type.size(); index++) {
+					if (!ids_per_type[index].empty()) {
+						World::destroy_table[index](ids_per_type[index].data(), ids_per_type[index].size());
+					}
+				}
+			}
+			//remove all components of all entities
+			static void remove_all_components() {
+				auto ids = world().signatures.get_ids();
+				std::sort(begin(ids), end(ids));
+				remove_all_components(ids);
+			}
+
+			//the world that owns the entities and components
+			static World &world() {
+				return World::current();
+			}
 
-				private:
-				//data
-				void (*f)(Impl::Id_t);
-				Impl::Id_t id;
-				const char *type_name;
-				//empty function to put into removers that have been moved from
-				static inline void remover_dummy(Impl::Id_t /*unused*/) {}
-			};
-			//it is important that removers is cleared before the system component vectors are destroyed
-			//it is also necessary to have removers be destroyed after all entities, because entities access removers in the destructor, don't know how to do
-			//that without leaking removers
-			protected:
-			static Impl::Id_t id_counter;
 			Impl::Id_t id;
-			static std::vector<Remover> removers;
-			friend bool operator<(Impl::Id_t id, const Remover &r);
+			friend struct ECS::Command_buffer;
+			friend struct ECS::Staging_buffer;
+			friend struct Snapshot_access;
 		};
-		inline bool operator<(Impl::Id_t id, const Entity_base::Remover &r) {
-			return r > id;
-		}
 	} // namespace Impl
 } // namespace ECS
 
@@ -17,14 +17,28 @@ namespace ECS {
 			id = other.id;
 			return *this;
 		}
-		//check if an entity is valid by converting to bool
+		//check if the entity is still alive by converting to bool, false for default constructed handles and handles of destroyed entities. O(1).
 		operator bool() {
-			return id != Impl::max_id;
+			return is_alive(id);
+		}
+		//handles of the same entity are equal, also after it was destroyed
+		bool operator==(const Entity_handle &other) const {
+			return id == other.id;
+		}
+		bool operator!=(const Entity_handle &other) const {
+			return id != other.id;
 		}
 		//"inherited" functions
 		using ECS::Impl::Entity_base::get;
+		using ECS::Impl::Entity_base::modify;
 		using ECS::Impl::Entity_base::remove;
 		//could maybe allow adding/emplacing components through a handle, but destroying an entity and using a handle to add components would leak the components
+
+		private:
+		friend struct Command_buffer;
+		friend struct System;
+		friend struct Staging_buffer;
+		friend struct Impl::Snapshot_access;
 	};
 } // namespace ECS
 
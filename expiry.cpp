@@ -0,0 +1,152 @@
+#include "expiry.h"
+#include "command_buffer.h"
+#include "entity.h"
+#include "trace.h"
+#include "utility/asserts.h"
+#include "world.h"
+
+#include <algorithm>
+#include <array>
+#include <utility>
+#include <vector>
+
+namespace {
+	struct Timer {
+		std::uint64_t expiry_frame;
+		ECS::Entity entity;
+	};
+
+	/*
+	A timer is in the level of the highest byte in which its expiry frame differs from the current frame, in the slot given by that byte of the expiry
+	frame. When the bytes below a level become 0 the slot of that level for the current frame holds the timers whose higher bytes now all match, they are
+	inserted again and end up in a lower level. Timers that differ above the last level wait in overflow.
+	*/
+	struct Timer_wheel {
+		static constexpr unsigned slot_bits = 8;
+		static constexpr std::size_t slot_count = std::size_t{1} << slot_bits;
+		static constexpr std::size_t level_count = 4;
+		static constexpr std::uint64_t slot_mask = slot_count - 1;
+
+		void insert(Timer &&timer) {
+			const auto differing = timer.expiry_frame ^ frame;
+			const std::size_t level = differing == 0 ? 0 : (63 - __builtin_clzll(differing)) / slot_bits;
+			if (level >= level_count) {
+				overflow.push_back(std::move(timer));
+				return;
+			}
+			levels[level][(timer.expiry_frame >> (level * slot_bits)) & slot_mask].push_back(std::move(timer));
+		}
+		//advance to the next frame and move the entities that expire in it to expired
+		void advance(ECS::Command_buffer &expired) {
+			frame++;
+			if ((frame & ((std::uint64_t{1} << (level_count * slot_bits)) - 1)) == 0) {
+				cascade(overflow);
+			}
+			for (auto level = level_count - 1; level > 0; level--) {
+				if ((frame & ((std::uint64_t{1} << (level * slot_bits)) - 1)) == 0) {
+					cascade(levels[level][(frame >> (level * slot_bits)) & slot_mask]);
+				}
+			}
+			auto &due = levels[0][frame & slot_mask];
+			for (auto &timer : due) {
+				assert_fast(timer.expiry_frame == frame);
+				expired.destroy(std::move(timer.entity));
+			}
+			size -= due.size();
+			due.clear();
+		}
+		void cascade(std::vector<Timer> &timers) {
+			std::vector<Timer> moved;
+			moved.swap(timers);
+			for (auto &timer : moved) {
+				insert(std::move(timer));
+			}
+		}
+		template <class Function>
+		void for_each_slot(Function &&f) {
+			for (auto &level : levels) {
+				for (auto &slot : level) {
+					f(slot);
+				}
+			}
+			f(overflow);
+		}
+
+		std::array<std::array<std::vector<Timer>, slot_count>, level_count> levels;
+		std::vector<Timer> overflow;
+		std::uint64_t frame = 0;
+		std::size_t size = 0;
+	};
+
+	//every World has its own frames and waiting entities
+	struct State {
+		Timer_wheel wheel;
+		std::vector<ECS::Remove_checker> checkers;
+	};
+	State &get_state() {
+		return ECS::World::current().get_state<State>();
+	}
+} // namespace
+
+void ECS::Expiry::expire_after(Entity &&entity, std::uint64_t frames) {
+	auto &wheel = get_state().wheel;
+	assert_fast(entity.is_valid());
+	wheel.insert({wheel.frame + std::max<std::uint64_t>(frames, 1), std::move(entity)});
+	wheel.size++;
+}
+
+void ECS::Expiry::add_checker(Remove_checker &&checker) {
+	get_state().checkers.push_back(std::move(checker));
+}
+
+void ECS::Expiry::end_frame() {
+	auto &state = get_state();
+	auto &wheel = state.wheel;
+	auto &checkers = state.checkers;
+	Command_buffer expired;
+	wheel.advance(expired);
+	//checkers may add checkers, those are first called in the next frame
+	const auto called_count = checkers.size();
+	std::size_t write = 0;
+	for (std::size_t read = 0; read < checkers.size(); read++) {
+		if (read < called_count && checkers[read].function(checkers[read].entity.to_handle())) {
+			expired.destroy(std::move(checkers[read].entity));
+			continue;
+		}
+		if (write != read) {
+			checkers[write] = std::move(checkers[read]);
+		}
+		write++;
+	}
+	checkers.erase(begin(checkers) + write, end(checkers));
+	TRACE("expiry frame", wheel.frame, wheel.size + checkers.size());
+	expired.flush();
+}
+
+std::uint64_t ECS::Expiry::current_frame() {
+	return get_state().wheel.frame;
+}
+
+std::size_t ECS::Expiry::size() {
+	const auto &state = get_state();
+	return state.wheel.size + state.checkers.size();
+}
+
+void ECS::Expiry::clear() {
+	auto &state = get_state();
+	auto &wheel = state.wheel;
+	auto &checkers = state.checkers;
+	Command_buffer expired;
+	wheel.for_each_slot([&expired](std::vector<Timer> &slot) {
+		for (auto &timer : slot) {
+			expired.destroy(std::move(timer.entity));
+		}
+		slot.clear();
+	});
+	wheel.size = 0;
+	for (auto &checker : checkers) {
+		expired.destroy(std::move(checker.entity));
+	}
+	checkers.clear();
+	expired.flush();
+}
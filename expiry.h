@@ -0,0 +1,36 @@
+#ifndef EXPIRY_H
+#define EXPIRY_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+Destroys entities whose life time ran out. Entities are handed over with Entity::expire_after or Entity::make_automatic and the ECS owns them from then on.
+Every call of System::run_systems ends one logical frame, which advances the expiry frame by one.
+Frame based life times are kept in a hierarchical timer wheel with 4 levels of 256 slots. Each frame only the due slot of the first level is visited and
+every 256^level frames one slot of a higher level is moved down, so the cost of a frame grows with the number of entities that expire, not with the number
+of entities that are waiting. Remove checkers are predicates, they are all called once per frame.
+Entities that expire in the same frame are destroyed together with one pass over every pool, see Command_buffer::flush.
+Every World has its own frames and waiting entities. None of these functions are thread safe, don't call them from parallel systems.
+*/
+
+namespace ECS {
+	struct Entity;
+	struct Remove_checker;
+	namespace Expiry {
+		//destroy the entity at the end of the frames-th frame, counting the current frame as the first. 0 is treated as 1.
+		void expire_after(Entity &&entity, std::uint64_t frames);
+		//destroy the entity of the checker at the end of the first frame in which its function returns true
+		void add_checker(Remove_checker &&checker);
+		//end the current frame: destroy the entities that expire in it and the entities whose checkers return true
+		void end_frame();
+		//number of frames that have ended
+		std::uint64_t current_frame();
+		//number of entities waiting in the timer wheel and in checkers
+		std::size_t size();
+		//destroy all waiting entities now
+		void clear();
+	} // namespace Expiry
+} // namespace ECS
+
+#endif // EXPIRY_H
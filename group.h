@@ -0,0 +1,104 @@
+#ifndef GROUP_H
+#define GROUP_H
+
+#include "entity_handle.h"
+#include "system_base.h"
+#include "utility.h"
+#include "utility/asserts.h"
+
+#include <cstddef>
+#include <tuple>
+
+namespace ECS {
+	/*
+	Owning group: the entities that have all components of the group are kept at the front of every pool of the group, in the same order.
+	Iterating over a group is a linear walk over the front of the pools without comparing ids.
+	Membership is updated when components are added or removed, which costs one swap per pool.
+	All components of a group must use Sparse_set_storage, because sorted pools cannot be reordered. A component can only be owned by one group.
+	*/
+	template <class... Components>
+	struct Group_view {
+		static_assert(sizeof...(Components) > 0, "A group needs components");
+		//number of entities that have all components of the group
+		std::size_t size() const {
+			return System::get_pool<First>().group_size;
+		}
+		//the component of the entity at the given position of the group
+		template <class Component>
+		Component &get(std::size_t index) const {
+			assert_fast(index < size());
+			return System::get_components<Component>()[index];
+		}
+		Entity_handle get_entity_handle(std::size_t index) const {
+			assert_fast(index < size());
+			return Entity_handle{System::get_ids<First>()[index]};
+		}
+		//call f(components &...) for every entity in the group
+		template <class Function>
+		void for_each(Function &&f) const {
+			const auto count = size();
+			auto pointers = std::make_tuple(System::get_components<Components>().data()...);
+			for (std::size_t i = 0; i < count; i++) {
+				f(std::get<Components *>(pointers)[i]...);
+			}
+		}
+
+		private:
+		using First = typename Utility::Type_list<Components...>::template nth<0>;
+	};
+
+	namespace Impl {
+		template <class... Components>
+		struct Group {
+			static void declare() {
+				static_assert((is_sparse_set<Components> && ...), "Components of owning groups must use Sparse_set_storage");
+				static_assert(sizeof...(Components) > 1, "Groups need at least 2 components");
+				assert_fast(((System::get_pool<Components>().group_emplaced == nullptr) && ...)); //a component can only be owned by one group
+				((System::get_pool<Components>().group_emplaced = emplaced), ...);
+				((System::get_pool<Components>().group_erasing = erasing), ...);
+				//group the entities that already have all components
+				auto &pool = System::get_pool<First>();
+				for (std::size_t slot = 0; slot < pool.size(); slot++) {
+					emplaced(pool.ids[slot]);
+				}
+			}
+
+			private:
+			using First = typename Utility::Type_list<Components...>::template nth<0>;
+			static std::size_t group_size() {
+				return System::get_pool<First>().group_size;
+			}
+			static void emplaced(Id_t id) {
+				if (((System::get_pool<Components>().find(id) == Pool<Components>::npos) || ...)) {
+					return;
+				}
+				if (System::get_pool<First>().find(id) < group_size()) { //already in the group
+					return;
+				}
+				const auto position = group_size();
+				((System::get_pool<Components>().swap_slots(System::get_pool<Components>().find(id), position)), ...);
+				((System::get_pool<Components>().group_size++), ...);
+			}
+			static void erasing(Id_t id) {
+				const auto slot = System::get_pool<First>().find(id);
+				if (slot == Pool<First>::npos || slot >= group_size()) {
+					return;
+				}
+				const auto position = group_size() - 1;
+				((System::get_pool<Components>().swap_slots(System::get_pool<Components>().find(id), position)), ...);
+				((System::get_pool<Components>().group_size--), ...);
+			}
+		};
+	} // namespace Impl
+
+	template <class... Components>
+	void System::add_group() {
+		Impl::Group<Utility::remove_cvr<Components>...>::declare();
+	}
+	template <class... Components>
+	Group_view<Utility::remove_cvr<Components>...> System::get_group() {
+		return {};
+	}
+} // namespace ECS
+
+#endif // GROUP_H
@@ -0,0 +1 @@
+#include "index.h"
\ No newline at end of file
@@ -0,0 +1,344 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include "change_log.h"
+#include "ecs_impl.h"
+#include "entity_handle.h"
+#include "pool.h"
+#include "sparse_index.h"
+#include "system_base.h"
+#include "system_iterator.h"
+#include "utility.h"
+#include "utility/asserts.h"
+#include "world.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ECS {
+	/*
+	Secondary indexes find the entities whose component field has a value or lies in a range of values without visiting every component, for example
+	the entities with HP::hp below 20. Declare an index with System::add_index<&HP::hp>() and get it with System::get_index<&HP::hp>().
+	Ordered_index keeps the values sorted, lookups cost O(log n + results). Hash_index only finds equal values, lookups cost O(1 + results).
+	Lookups return the ids of the found entities sorted by id, which System::range joins with other components like a pool:
+		const auto weak = System::get_index<&HP::hp>().below(20);
+		for (auto sit = System::range<const HP, Position>(weak); sit; sit.advance()) {...}
+	Indexes are updated from the change log of the pool, so the Storage_policy of the component must set track_changes and, like change filters, they
+	only notice changes made through modify, see change_log.h. Every lookup first applies the additions, changes and removals since the previous lookup,
+	so an index costs O(log n) per change and nothing for components that don't change. If more than a quarter of the entries changed, the index is
+	rebuilt with one sort instead.
+	Lookups of the same index may run at the same time, but not at the same time as changes to the component. Finish changing a component before looking
+	it up, a lookup between modify and the assignment sees the old value. Every World has its own indexes.
+	*/
+	struct Ordered_index {};
+	struct Hash_index {};
+
+	//the entities found by an index lookup
+	struct Index_result {
+		std::size_t size() const {
+			return ids.size() - 1;
+		}
+		bool empty() const {
+			return size() == 0;
+		}
+		Entity_handle operator[](std::size_t position) const {
+			assert_fast(position < size());
+			return Entity_handle{ids[position]};
+		}
+
+		//sorted by id and terminated by max_id, so it can drive a System_iterator
+		std::vector<Impl::Id_t> ids{Impl::max_id};
+	};
+
+	namespace Impl {
+		//the (key, id) pairs of an index
+		template <class Key, class Kind>
+		struct Index_entries;
+		//the entries are sorted and split into blocks of at most block_capacity, so lookups walk contiguous memory and a change only moves the entries of
+		//one block
+		template <class Key>
+		struct Index_entries<Key, Ordered_index> {
+			using Entry = std::pair<Key, Id_t>;
+			static constexpr std::size_t block_capacity = 256;
+
+			static bool same_key(const Key &lhs, const Key &rhs) {
+				return !(lhs < rhs) && !(rhs < lhs);
+			}
+			//fill empty entries with the (id, key) pairs of keyed with one sort
+			void build(const std::vector<std::pair<Id_t, Key>> &keyed) {
+				std::vector<Entry> sorted;
+				sorted.reserve(keyed.size());
+				for (const auto &id_key : keyed) {
+					sorted.emplace_back(id_key.second, id_key.first);
+				}
+				std::sort(begin(sorted), end(sorted));
+				//half full blocks leave room for insertions
+				for (std::size_t first = 0; first < sorted.size(); first += block_capacity / 2) {
+					const auto last = std::min(first + block_capacity / 2, sorted.size());
+					blocks.emplace_back(std::make_move_iterator(begin(sorted) + first), std::make_move_iterator(begin(sorted) + last));
+				}
+			}
+			void insert(const Key &key, Id_t id) {
+				const Entry entry{key, id};
+				if (blocks.empty()) {
+					blocks.push_back({entry});
+					return;
+				}
+				const auto block_index = std::min(find_block(entry), blocks.size() - 1);
+				auto &block = blocks[block_index];
+				block.insert(std::upper_bound(begin(block), end(block), entry), entry);
+				if (block.size() > block_capacity) {
+					const auto middle = begin(block) + block.size() / 2;
+					std::vector<Entry> upper_half(std::make_move_iterator(middle), std::make_move_iterator(end(block)));
+					block.erase(middle, end(block));
+					blocks.insert(begin(blocks) + block_index + 1, std::move(upper_half));
+				}
+			}
+			void erase(const Key &key, Id_t id) {
+				const Entry entry{key, id};
+				const auto block_index = find_block(entry);
+				auto &block = blocks[block_index];
+				block.erase(std::lower_bound(begin(block), end(block), entry));
+				//merge small neighbours so erasing does not leave many tiny blocks
+				if (block_index + 1 < blocks.size() && block.size() + blocks[block_index + 1].size() <= block_capacity / 2) {
+					auto &next = blocks[block_index + 1];
+					std::move(begin(next), end(next), std::back_inserter(block));
+					blocks.erase(begin(blocks) + block_index + 1);
+				}
+				if (block.empty()) {
+					blocks.erase(begin(blocks) + block_index);
+				}
+			}
+			//call f(id) for the entries from the first one whose key is not less than low while keep(key) holds
+			template <class Keep, class Function>
+			void for_each_from(const Key &low, Keep &&keep, Function &&f) const {
+				const Entry first{low, Id_t{0}};
+				const auto block_index = find_block(first);
+				if (block_index < blocks.size()) {
+					const auto &block = blocks[block_index];
+					for_each(block_index, std::lower_bound(begin(block), end(block), first) - begin(block), keep, f);
+				}
+			}
+			//call f(id) for the entries from the smallest key on while keep(key) holds
+			template <class Keep, class Function>
+			void for_each_from_start(Keep &&keep, Function &&f) const {
+				for_each(0, 0, keep, f);
+			}
+			template <class Function>
+			void for_each_equal(const Key &key, Function &&f) const {
+				for_each_from(key, [&key](const Key &entry_key) { return !(key < entry_key); }, f);
+			}
+
+			private:
+			//the first block whose last entry is not less than entry, blocks.size() if there is none
+			std::size_t find_block(const Entry &entry) const {
+				return std::lower_bound(begin(blocks), end(blocks), entry, [](const std::vector<Entry> &block, const Entry &e) { return block.back() < e; }) -
+					   begin(blocks);
+			}
+			template <class Keep, class Function>
+			void for_each(std::size_t block_index, std::size_t position, Keep &&keep, Function &&f) const {
+				for (; block_index < blocks.size(); block_index++, position = 0) {
+					const auto &block = blocks[block_index];
+					for (; position < block.size(); position++) {
+						if (!keep(block[position].first)) {
+							return;
+						}
+						f(block[position].second);
+					}
+				}
+			}
+
+			std::vector<std::vector<Entry>> blocks;
+		};
+		template <class Key>
+		struct Index_entries<Key, Hash_index> {
+			static bool same_key(const Key &lhs, const Key &rhs) {
+				return lhs == rhs;
+			}
+			void build(const std::vector<std::pair<Id_t, Key>> &keyed) {
+				for (const auto &id_key : keyed) {
+					insert(id_key.second, id_key.first);
+				}
+			}
+			void insert(const Key &key, Id_t id) {
+				buckets[key].push_back(id);
+			}
+			//costs O(number of entities with the same key)
+			void erase(const Key &key, Id_t id) {
+				const auto bucket = buckets.find(key);
+				auto &ids = bucket->second;
+				*std::find(begin(ids), end(ids), id) = ids.back();
+				ids.pop_back();
+				if (ids.empty()) {
+					buckets.erase(bucket);
+				}
+			}
+			template <class Function>
+			void for_each_equal(const Key &key, Function &&f) const {
+				const auto bucket = buckets.find(key);
+				if (bucket != end(buckets)) {
+					for (auto id : bucket->second) {
+						f(id);
+					}
+				}
+			}
+
+			std::unordered_map<Key, std::vector<Id_t>> buckets;
+		};
+	} // namespace Impl
+
+	//an index on one field of a component, see the top of this file
+	template <auto field, class Kind>
+	struct Index {
+		using Component = typename Utility::Member_pointer_traits<decltype(field)>::Class;
+		using Key = typename Utility::Member_pointer_traits<decltype(field)>::Member;
+		static_assert(Impl::tracks_changes<Component>, "Indexes are updated from the change log, the Storage_policy of the component must set track_changes");
+		static_assert(!Impl::is_tag_storage<Component>, "Tags have no fields to index");
+
+		//the entities whose field equals key
+		Index_result equal(const Key &key) {
+			return lookup([this, &key](auto &&f) { entries.for_each_equal(key, f); });
+		}
+		//the entities whose field is at least low and less than high, only for Ordered_index
+		Index_result between(const Key &low, const Key &high) {
+			static_assert(std::is_same<Kind, Ordered_index>::value, "Only ordered indexes can find ranges of values");
+			return lookup([this, &low, &high](auto &&f) { entries.for_each_from(low, [&high](const Key &key) { return key < high; }, f); });
+		}
+		//the entities whose field is less than high, only for Ordered_index
+		Index_result below(const Key &high) {
+			static_assert(std::is_same<Kind, Ordered_index>::value, "Only ordered indexes can find ranges of values");
+			return lookup([this, &high](auto &&f) { entries.for_each_from_start([&high](const Key &key) { return key < high; }, f); });
+		}
+		//the entities whose field is at least low, only for Ordered_index
+		Index_result at_least(const Key &low) {
+			static_assert(std::is_same<Kind, Ordered_index>::value, "Only ordered indexes can find ranges of values");
+			return lookup([this, &low](auto &&f) { entries.for_each_from(low, [](const Key &) { return true; }, f); });
+		}
+		//apply the changes since the last lookup, the next lookup only has to apply the changes after this
+		void update() {
+			const std::lock_guard<std::mutex> lock(mutex);
+			apply_changes();
+		}
+
+		private:
+		using Pool = Impl::Pool<Component>;
+		template <class Collect>
+		Index_result lookup(Collect &&collect) {
+			const std::lock_guard<std::mutex> lock(mutex);
+			apply_changes();
+			Index_result result;
+			result.ids.pop_back();
+			collect([&result](Impl::Id_t id) { result.ids.push_back(id); });
+			std::sort(begin(result.ids), end(result.ids));
+			result.ids.push_back(Impl::max_id);
+			return result;
+		}
+		void apply_changes() {
+			auto &pool = System::get_pool<Component>();
+			//starting a new tick keeps changes made before this out of the next update
+			const auto tick = Changes::advance_tick();
+			//the log says which components to look at, the pool has their current state
+			std::vector<Impl::Id_t> changed_ids;
+			if (synced_tick != 0) {
+				pool.changes.for_each_change(synced_tick, [&changed_ids](Impl::Id_t id, bool) { changed_ids.push_back(id); });
+				pool.changes.for_each_removal(synced_tick, [&changed_ids](Impl::Id_t id) { changed_ids.push_back(id); });
+			}
+			//removals that Snapshot::forget_changes dropped before they were applied leave entries of components that no longer exist.
+			//Sorting all entries once is also cheaper than moving them into place one by one when many changed.
+			if (synced_tick == 0 || synced_tick < pool.changes.get_forgotten_tick() || changed_ids.size() > keys.size() / 4) {
+				rebuild(pool);
+			} else {
+				for (auto id : changed_ids) {
+					refresh(pool, id);
+				}
+			}
+			synced_tick = tick;
+		}
+		void rebuild(Pool &pool) {
+			entries = {};
+			keys.clear();
+			positions.clear();
+			keys.reserve(pool.size());
+			for (std::size_t slot = 0; slot < pool.size(); slot++) {
+				positions.set(pool.ids[slot], static_cast<Impl::Sparse_index::Slot_t>(keys.size()));
+				keys.emplace_back(pool.ids[slot], value(pool, slot));
+			}
+			entries.build(keys);
+		}
+		static const Key &value(Pool &pool, std::size_t slot) {
+			if constexpr (Impl::is_column_storage<Component>) {
+				return pool.template column<field>()[slot];
+			} else {
+				return pool.components[slot].*field;
+			}
+		}
+		//make the entry of id match the pool
+		void refresh(Pool &pool, Impl::Id_t id) {
+			const auto slot = pool.find(id);
+			if (slot == Pool::npos) {
+				unset(id);
+			} else {
+				set(id, value(pool, slot));
+			}
+		}
+		void set(Impl::Id_t id, const Key &key) {
+			const auto position = positions.get(id);
+			if (position == Impl::Sparse_index::npos) {
+				positions.set(id, static_cast<Impl::Sparse_index::Slot_t>(keys.size()));
+				keys.emplace_back(id, key);
+				entries.insert(key, id);
+				return;
+			}
+			//the entry may belong to an earlier entity with the same index whose removal was never seen
+			auto &entry = keys[position];
+			if (entry.first == id && entries.same_key(entry.second, key)) {
+				return;
+			}
+			entries.erase(entry.second, entry.first);
+			entry = {id, key};
+			entries.insert(key, id);
+		}
+		void unset(Impl::Id_t id) {
+			const auto position = positions.get(id);
+			if (position == Impl::Sparse_index::npos || keys[position].first != id) {
+				return;
+			}
+			entries.erase(keys[position].second, id);
+			if (position != keys.size() - 1) {
+				keys[position] = std::move(keys.back());
+				positions.move(keys[position].first, position);
+			}
+			keys.pop_back();
+			positions.erase(id);
+		}
+
+		Impl::Index_entries<Key, Kind> entries;
+		//the id and key of every indexed component and the position of each id in keys
+		std::vector<std::pair<Impl::Id_t, Key>> keys;
+		Impl::Sparse_index positions;
+		//changes at or after synced_tick have not been applied, 0 if the index was never built
+		Changes::Tick_t synced_tick = 0;
+		std::mutex mutex;
+	};
+
+	template <auto field, class Kind>
+	void System::add_index() {
+		get_index<field, Kind>().update();
+	}
+	template <auto field, class Kind>
+	Index<field, Kind> &System::get_index() {
+		return World::current().get_state<Index<field, Kind>>();
+	}
+	template <class... Components>
+	System_iterator<Components...> System::range(const Index_result &entities) {
+		return System_iterator<Components...>{entities.ids, 0};
+	}
+} // namespace ECS
+
+#endif // INDEX_H
@@ -12,12 +12,38 @@
 #define LOG_LEVEL_DEFAULT LOG_LEVEL_ALL
 #endif
 
+//define LOG_LEVEL before including the ECS to override the default
+#ifndef LOG_LEVEL
 #define LOG_LEVEL LOG_LEVEL_DEFAULT
+#endif
 
-#include <functional>
 #include <iostream>
+#include <utility>
+
+/*
+Use the macros to log, for example LOG_DEBUG << "Entity " << id;
+If the level is disabled the whole statement is dead code, so the arguments are not evaluated and cost nothing. They are still compiled, so logging code
+does not rot in release builds.
+The log_* functions return a logger directly, their arguments are always evaluated.
+*/
+#define LOG_NOTE                 \
+	if (!Log::note_enabled) {    \
+	} else                       \
+		Log::log_note()
+#define LOG_DEBUG                \
+	if (!Log::debug_enabled) {   \
+	} else                       \
+		Log::log_debug()
+#define LOG_ALL                  \
+	if (!Log::all_enabled) {     \
+	} else                       \
+		Log::log_all()
 
 namespace Log {
+	constexpr bool note_enabled = LOG_LEVEL >= 3;
+	constexpr bool debug_enabled = LOG_LEVEL >= 2;
+	constexpr bool all_enabled = LOG_LEVEL >= 1;
+
 	struct Log_dummy {
 		template <class T>
 		Log_dummy &operator<<(T && /*unused*/) {
@@ -36,26 +62,26 @@ namespace Log {
 	};
 
 	inline auto log_note() {
-#if LOG_LEVEL >= 3
-		return Log_real{};
-#else
-		return Log_dummy{};
-#endif
+		if constexpr (note_enabled) {
+			return Log_real{};
+		} else {
+			return Log_dummy{};
+		}
 	}
 	inline auto log_debug() {
-#if LOG_LEVEL >= 2
-		return Log_real{};
-#else
-		return Log_dummy{};
-#endif
+		if constexpr (debug_enabled) {
+			return Log_real{};
+		} else {
+			return Log_dummy{};
+		}
 	}
 	inline auto log_all() {
-#if LOG_LEVEL >= 1
-		return Log_real{};
-#else
-		return Log_dummy{};
-#endif
+		if constexpr (all_enabled) {
+			return Log_real{};
+		} else {
+			return Log_dummy{};
+		}
 	}
 }; // namespace Log
 
-#endif // LOG_H
\ No newline at end of file
+#endif // LOG_H
@@ -0,0 +1,387 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "change_log.h"
+#include "ecs_impl.h"
+#include "sparse_index.h"
+#include "utility.h"
+#include "utility/asserts.h"
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ECS {
+	//storage policies, select one per component type by specializing Storage_policy
+	//ids are kept sorted, iteration over multiple components is a cheap merge, but adding and removing components is O(n)
+	struct Sorted_storage {};
+	//ids are kept in a sparse set, adding, removing and looking up components is O(1), iteration is dense but not ordered by id
+	struct Sparse_set_storage {};
+	//ids are kept sorted and every field of the component is stored in its own aligned vector, see column_pool.h
+	struct Column_storage {};
+	//for empty types: only the ids and a bitmap of entity indexes are stored, see tag_pool.h
+	struct Tag_storage {};
+	//empty types are tags, everything else is sorted by default
+	template <class Component>
+	struct Storage_policy {
+		using type = std::conditional_t<std::is_empty<Component>::value, Tag_storage, Sorted_storage>;
+	};
+	/* Example:
+	template <>
+	struct ECS::Storage_policy<Common_components::HP> {
+		using type = ECS::Sparse_set_storage;
+	};
+	Any storage can record when components were added, changed through modify and removed, which Snapshot::write_delta sends to replicas:
+	template <>
+	struct ECS::Storage_policy<Common_components::HP> {
+		using type = ECS::Sorted_storage;
+		static constexpr bool track_changes = true;
+	};
+	Sorted and sparse set storage can also pick the allocator of the component vector, for example huge pages or a std::pmr resource that is passed
+	to System::set_allocator. Ids and the columns of Column_storage always use the default allocator.
+	template <>
+	struct ECS::Storage_policy<Common_components::HP> {
+		using type = ECS::Sorted_storage;
+		template <class T>
+		using allocator = std::pmr::polymorphic_allocator<T>;
+	};
+	Column_storage also needs the list of fields:
+	template <>
+	struct ECS::Storage_policy<Common_components::HP> {
+		using type = ECS::Column_storage;
+		static constexpr auto columns = std::make_tuple(&Common_components::HP::hp, &Common_components::HP::max_hp);
+	};
+	*/
+
+	namespace Impl {
+		template <class Component>
+		constexpr bool is_sparse_set = std::is_same<typename Storage_policy<Utility::remove_cvr<Component>>::type, Sparse_set_storage>::value;
+		template <class Component>
+		constexpr bool is_column_storage = std::is_same<typename Storage_policy<Utility::remove_cvr<Component>>::type, Column_storage>::value;
+		template <class Component>
+		constexpr bool is_tag_storage = std::is_same<typename Storage_policy<Utility::remove_cvr<Component>>::type, Tag_storage>::value;
+		template <class Component, class = void>
+		constexpr bool tracks_changes = false;
+		template <class Component>
+		constexpr bool tracks_changes<Component, std::void_t<decltype(Storage_policy<Component>::track_changes)>> = Storage_policy<Component>::track_changes;
+		//Storage_policy<Component>::allocator<Component> if the policy has one, otherwise std::allocator<Component>
+		template <class Component, class = void>
+		struct Policy_allocator {
+			using type = std::allocator<Component>;
+		};
+		template <class Component>
+		struct Policy_allocator<Component, std::void_t<typename Storage_policy<Component>::template allocator<Component>>> {
+			using type = typename Storage_policy<Component>::template allocator<Component>;
+		};
+
+		//find the first position at or after start whose id is at least target in ids sorted ascending and terminated by max_id.
+		//Doubles the step until it overshoots and then binary searches the last step, so the cost is logarithmic in the distance skipped.
+		inline std::size_t gallop_search(const std::vector<Id_t> &ids, std::size_t start, Id_t target) {
+			const auto last = ids.size() - 1;
+			auto low = start;
+			std::size_t step = 1;
+			auto high = std::min(start + step, last);
+			while (ids[high] < target) {
+				low = high;
+				step *= 2;
+				high = std::min(start + step, last);
+			}
+			return std::lower_bound(begin(ids) + low + 1, begin(ids) + high, target) - begin(ids);
+		}
+		//same as gallop_search, but checks the next position first because dense joins mostly advance by one
+		inline std::size_t gallop(const std::vector<Id_t> &ids, std::size_t start, Id_t target) {
+			if (ids[start] >= target) {
+				return start;
+			}
+			if (ids[start + 1] >= target) { //ids[start] < target, so start cannot be the max_id at the end
+				return start + 1;
+			}
+			return gallop_search(ids, start + 1, target);
+		}
+		//find the position of id in ids sorted ascending and terminated by max_id, or the position where it would be inserted. hint is where id was
+		//stored when it was added. Components only shift by the number of insertions and removals in front of them, so galloping from the hint is
+		//logarithmic in that distance and a hint that is still exact costs one compare.
+		inline std::size_t gallop_from_hint(const std::vector<Id_t> &ids, std::size_t hint, Id_t id) {
+			hint = std::min(hint, ids.size() - 1);
+			if (ids[hint] >= id) {
+				if (ids[hint] == id || hint == 0) {
+					return hint;
+				}
+				//ids[high] >= id, search backwards until a smaller id is found
+				auto high = hint;
+				std::size_t step = 1;
+				auto low = hint - 1;
+				while (low > 0 && ids[low] >= id) {
+					high = low;
+					step *= 2;
+					low = hint > step ? hint - step : 0;
+				}
+				return std::lower_bound(begin(ids) + low, begin(ids) + high, id) - begin(ids);
+			}
+			return gallop_search(ids, hint, id);
+		}
+
+		//all components of one type and the ids of the entities owning them
+		template <class Component, class Policy = typename Storage_policy<Component>::type>
+		struct Pool {
+			static constexpr std::size_t npos = -1;
+			static constexpr bool sparse = is_sparse_set<Component>;
+			using Allocator = typename Policy_allocator<Component>::type;
+			using Component_vector = std::vector<Component, Allocator>;
+
+			//components[x] belongs to the entity ids[x]. ids has an extra max_id at the end so iterators can stop without checking the size
+			Component_vector components;
+			std::vector<Id_t> ids{max_id};
+			//maps ids to their position in ids and components. Sparse sets keep the positions exact. Sorted pools only store the position an id had
+			//when it was added and don't touch the entries of components they shift, so find gallops from that hint when it went stale.
+			Sparse_index slots;
+			//only used if tracks_changes<Component>
+			Change_log changes;
+			//only used while the type has observers
+			Pool_events events;
+
+			std::size_t size() const {
+				return components.size();
+			}
+			//make room for capacity components so adding components does not reallocate until the pool is bigger
+			void reserve(std::size_t capacity) {
+				components.reserve(capacity);
+				ids.reserve(capacity + 1);
+			}
+			//free memory that is not used by the current components
+			void shrink() {
+				components.shrink_to_fit();
+				ids.shrink_to_fit();
+			}
+			//allocate components with allocator from now on, the pool must be empty
+			void set_allocator(const Allocator &allocator) {
+				assert_fast(components.empty()); //the components would have to be copied to the new allocator
+				//allocators like std::pmr::polymorphic_allocator are not replaced by assigning or swapping vectors, so construct a new vector
+				components.~Component_vector();
+				new (&components) Component_vector(allocator);
+			}
+			//construct a component for the entity with the given id, the entity must not already have a component of this type
+			template <class... Args>
+			Component &emplace(Id_t id, Args &&... args) {
+				if constexpr (sparse) {
+					assert_fast(!slots.contains(id)); //disallow multiple components of the same type for the same entity
+					construct(components.end(), std::forward<Args>(args)...);
+					ids.back() = id;
+					ids.push_back(max_id);
+					slots.set(id, static_cast<Sparse_index::Slot_t>(components.size() - 1));
+					record_added(id);
+					if (group_emplaced) {
+						group_emplaced(id);
+					}
+					return components[slots.get(id)];
+				} else {
+					auto insert_position = std::lower_bound(begin(ids), end(ids), id);
+					assert_fast(*insert_position != id); //disallow multiple components of the same type for the same entity
+					const std::size_t slot = insert_position - begin(ids);
+					auto inserted_component = construct(begin(components) + slot, std::forward<Args>(args)...);
+					ids.insert(insert_position, id);
+					slots.set(id, static_cast<Sparse_index::Slot_t>(slot));
+					record_added(id);
+					assert_all(std::is_sorted(begin(ids), end(ids)));
+					return *inserted_component;
+				}
+			}
+			//remove the component of the entity with the given id, the entity must have a component of this type
+			void erase(Id_t id) {
+				if constexpr (sparse) {
+					auto slot = slots.get(id);
+					assert_fast(slot != Sparse_index::npos); //make sure the component to remove exists
+					if (group_erasing) {
+						group_erasing(id);
+						slot = slots.get(id);
+					}
+					const auto last = components.size() - 1;
+					if (slot != last) { //swap and pop
+						components[slot] = std::move(components[last]);
+						ids[slot] = ids[last];
+						slots.set(ids[slot], slot);
+					}
+					components.pop_back();
+					ids.pop_back();
+					ids.back() = max_id;
+					slots.erase(id);
+					record_removed(id);
+				} else {
+					const auto slot = find(id);
+					assert_fast(slot != npos); //make sure the component to remove exists
+					components.erase(begin(components) + slot);
+					ids.erase(begin(ids) + slot);
+					slots.erase(id);
+					record_removed(id);
+					assert_all(std::is_sorted(begin(ids), end(ids)));
+				}
+			}
+			//add components for count entities with the given sorted ids, make(i) constructs the component for new_ids[i].
+			//New entities mostly get new indexes, so their ids normally go to the end and no existing element needs to move. Otherwise the new
+			//components are merged in with one pass.
+			template <class Make>
+			void append(const Id_t *new_ids, std::size_t count, Make &&make) {
+				if (count == 0) {
+					return;
+				}
+				if (!sparse && size() != 0 && ids[size() - 1] >= new_ids[0]) { //cannot append, merge
+					std::vector<std::pair<Id_t, Component>> entries;
+					entries.reserve(count);
+					for (std::size_t i = 0; i < count; i++) {
+						entries.emplace_back(new_ids[i], make(i));
+					}
+					insert_sorted(entries);
+					return;
+				}
+				components.reserve(size() + count);
+				ids.reserve(size() + count + 1);
+				ids.pop_back();
+				for (std::size_t i = 0; i < count; i++) {
+					construct(components.end(), make(i));
+					ids.push_back(new_ids[i]);
+					assert_fast(!slots.contains(new_ids[i])); //disallow multiple components of the same type for the same entity
+					slots.set(new_ids[i], static_cast<Sparse_index::Slot_t>(components.size() - 1));
+					record_added(new_ids[i]);
+					if constexpr (sparse) {
+						if (group_emplaced) {
+							group_emplaced(new_ids[i]);
+						}
+					}
+				}
+				ids.push_back(max_id);
+				assert_all(sparse || std::is_sorted(begin(ids), end(ids)));
+			}
+			//remove the components of count entities with the given sorted ids, sorted pools are compacted in one pass
+			void erase_sorted(const Id_t *erase_ids, std::size_t count) {
+				if (sparse || count == 1) {
+					for (std::size_t i = 0; i < count; i++) {
+						erase(erase_ids[i]);
+					}
+					return;
+				}
+				if (count == 0) {
+					return;
+				}
+				const auto old_size = size();
+				auto write = static_cast<std::size_t>(std::lower_bound(begin(ids), end(ids), erase_ids[0]) - begin(ids));
+				std::size_t next_erase = 0;
+				for (auto read = write; read < old_size; read++) {
+					if (next_erase < count && ids[read] == erase_ids[next_erase]) {
+						slots.erase(ids[read]);
+						record_removed(ids[read]);
+						next_erase++;
+						continue;
+					}
+					if (write != read) {
+						ids[write] = ids[read];
+						components[write] = std::move(components[read]);
+					}
+					write++;
+				}
+				assert_fast(next_erase == count); //make sure all components to remove existed
+				components.erase(begin(components) + write, end(components));
+				ids.erase(begin(ids) + write, end(ids) - 1);
+				assert_all(std::is_sorted(begin(ids), end(ids)));
+			}
+			//insert components for entities given as (id, component) pairs sorted by id.
+			//Only the elements after the first new id are moved, so appending new entities does not touch existing components.
+			void insert_sorted(std::vector<std::pair<Id_t, Component>> &entries) {
+				if (sparse || entries.size() == 1) {
+					for (auto &entry : entries) {
+						emplace(entry.first, std::move(entry.second));
+					}
+					return;
+				}
+				if (entries.empty()) {
+					return;
+				}
+				const auto first = std::lower_bound(begin(ids), end(ids), entries.front().first) - begin(ids);
+				Component_vector tail_components(std::make_move_iterator(begin(components) + first), std::make_move_iterator(end(components)),
+												 components.get_allocator());
+				std::vector<Id_t> tail_ids(begin(ids) + first, end(ids)); //includes the max_id at the end
+				components.erase(begin(components) + first, end(components));
+				ids.erase(begin(ids) + first, end(ids));
+				components.reserve(components.size() + tail_components.size() + entries.size());
+				ids.reserve(components.capacity() + 1);
+				std::size_t tail = 0;
+				const auto push_tail = [&] {
+					ids.push_back(tail_ids[tail]);
+					components.push_back(std::move(tail_components[tail]));
+				};
+				for (auto &entry : entries) {
+					for (; tail_ids[tail] < entry.first; tail++) {
+						push_tail();
+					}
+					assert_fast(tail_ids[tail] != entry.first); //disallow multiple components of the same type for the same entity
+					slots.set(entry.first, static_cast<Sparse_index::Slot_t>(ids.size()));
+					record_added(entry.first);
+					ids.push_back(entry.first);
+					components.push_back(std::move(entry.second));
+				}
+				for (; tail < tail_components.size(); tail++) {
+					push_tail();
+				}
+				ids.push_back(max_id);
+				assert_all(std::is_sorted(begin(ids), end(ids)));
+			}
+			//get the position of the component of the entity with the given id or npos if it has none. O(1) for sparse sets and for sorted pools whose
+			//components did not shift since id was added.
+			std::size_t find(Id_t id) const {
+				const auto hint = slots.get(id);
+				if (hint == Sparse_index::npos) {
+					return npos;
+				}
+				const auto slot = sparse ? hint : gallop_from_hint(ids, hint, id);
+				return ids[slot] != id ? npos : slot;
+			}
+
+			//exchange the positions of two components of a sparse set
+			void swap_slots(std::size_t lhs, std::size_t rhs) {
+				static_assert(sparse, "Sorted pools must stay sorted");
+				if (lhs == rhs) {
+					return;
+				}
+				using std::swap;
+				swap(components[lhs], components[rhs]);
+				swap(ids[lhs], ids[rhs]);
+				slots.set(ids[lhs], static_cast<Sparse_index::Slot_t>(lhs));
+				slots.set(ids[rhs], static_cast<Sparse_index::Slot_t>(rhs));
+			}
+
+			//owning group support, see group.h. The first group_size components are the ones of the entities that have all components of the group
+			//in the same order in all pools of the group.
+			std::size_t group_size = 0;
+			//called after a component was added and before a component is removed to keep the group packed
+			void (*group_emplaced)(Id_t id) = nullptr;
+			void (*group_erasing)(Id_t id) = nullptr;
+
+			private:
+			void record_added(Id_t id) {
+				events.added(id);
+				if constexpr (tracks_changes<Component>) {
+					changes.added(id);
+				}
+			}
+			void record_removed(Id_t id) {
+				events.removed(id);
+				if constexpr (tracks_changes<Component>) {
+					changes.removed(id);
+				}
+			}
+			template <class... Args>
+			typename Component_vector::iterator construct(typename Component_vector::iterator position, Args &&... args) {
+				if constexpr (std::is_pod<Component>::value) {
+					return components.insert(position, Component{std::forward<Args>(args)...});
+				} else {
+					return components.emplace(position, std::forward<Args>(args)...);
+				}
+			}
+		};
+	} // namespace Impl
+} // namespace ECS
+
+#endif // POOL_H
@@ -0,0 +1,188 @@
+#include "profiler.h"
+#include "thread_pool.h"
+#include "world.h"
+
+#include <chrono>
+#include <iomanip>
+#include <ostream>
+
+#if defined(ECS_PROFILE) && defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	//every World profiles its own frames
+	struct State {
+		std::deque<ECS::Profiler::Frame> frames;
+		std::size_t frame_capacity = 300;
+		bool hardware_counters_enabled = false;
+	};
+	State &get_state() {
+		return ECS::World::current().get_state<State>();
+	}
+
+	//trace event times are in microseconds, write them without losing nanoseconds to floating point formatting
+	void write_microseconds(std::ostream &output, std::uint64_t nanoseconds) {
+		output << nanoseconds / 1000 << '.' << std::setw(3) << std::setfill('0') << nanoseconds % 1000 << std::setfill(' ');
+	}
+
+#ifdef ECS_PROFILE
+	std::uint64_t now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	//per thread perf counters for cycles and cache misses, opened on first use
+	struct Hardware_counters {
+		Hardware_counters() {
+#ifdef __linux__
+			cycles = open_counter(PERF_COUNT_HW_CPU_CYCLES);
+			cache_misses = open_counter(PERF_COUNT_HW_CACHE_MISSES);
+#endif
+		}
+		Hardware_counters(const Hardware_counters &) = delete;
+		Hardware_counters &operator=(const Hardware_counters &) = delete;
+		~Hardware_counters() {
+#ifdef __linux__
+			for (auto fd : {cycles, cache_misses}) {
+				if (fd >= 0) {
+					close(fd);
+				}
+			}
+#endif
+		}
+		static std::uint64_t read_counter(int fd) {
+			std::uint64_t value = 0;
+#ifdef __linux__
+			if (fd >= 0 && read(fd, &value, sizeof value) != sizeof value) {
+				value = 0;
+			}
+#endif
+			return value;
+		}
+
+		int cycles = -1;
+		int cache_misses = -1;
+
+		private:
+#ifdef __linux__
+		static int open_counter(std::uint64_t config) {
+			perf_event_attr attributes{};
+			attributes.type = PERF_TYPE_HARDWARE;
+			attributes.size = sizeof attributes;
+			attributes.config = config;
+			attributes.exclude_kernel = 1;
+			attributes.exclude_hv = 1;
+			return static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+		}
+#endif
+	};
+	Hardware_counters &get_hardware_counters() {
+		thread_local Hardware_counters counters;
+		return counters;
+	}
+#endif
+} // namespace
+
+const std::deque<ECS::Profiler::Frame> &ECS::Profiler::get_frames() {
+	return get_state().frames;
+}
+
+void ECS::Profiler::set_frame_capacity(std::size_t capacity) {
+	auto &state = get_state();
+	state.frame_capacity = capacity;
+	while (state.frames.size() > state.frame_capacity) {
+		state.frames.pop_front();
+	}
+}
+
+void ECS::Profiler::clear() {
+	get_state().frames.clear();
+}
+
+void ECS::Profiler::enable_hardware_counters(bool enable) {
+	get_state().hardware_counters_enabled = enable;
+}
+
+void ECS::Profiler::write_chrome_trace(std::ostream &output) {
+	const auto &frames = get_state().frames;
+	output << "{\"traceEvents\":[";
+	bool first = true;
+	for (const auto &frame : frames) {
+		output << (first ? "\n" : ",\n") << "{\"name\":\"frame\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":";
+		write_microseconds(output, frame.begin);
+		output << ",\"dur\":";
+		write_microseconds(output, frame.duration);
+		output << "}";
+		first = false;
+		for (const auto &sample : frame.systems) {
+			output << ",\n{\"name\":\"";
+			if (sample.name) {
+				//escape the characters JSON does not allow in strings
+				for (auto c = sample.name; *c; c++) {
+					if (*c == '"' || *c == '\\') {
+						output << '\\' << *c;
+					} else if (static_cast<unsigned char>(*c) >= 0x20) {
+						output << *c;
+					}
+				}
+			} else {
+				output << "system " << sample.system;
+			}
+			output << "\",\"cat\":\"system\",\"ph\":\"X\",\"pid\":0,\"tid\":" << sample.thread << ",\"ts\":";
+			write_microseconds(output, sample.begin);
+			output << ",\"dur\":";
+			write_microseconds(output, sample.duration);
+			output << ",\"args\":{\"system\":" << sample.system << ",\"entities\":" << sample.entities << ",\"cycles\":" << sample.cycles
+				   << ",\"cache_misses\":" << sample.cache_misses << "}}";
+		}
+	}
+	output << "\n]}\n";
+}
+
+#ifdef ECS_PROFILE
+void ECS::Profiler::Impl::begin_frame(std::size_t system_count) {
+	auto &state = get_state();
+	if (state.frame_capacity == 0) {
+		return;
+	}
+	if (state.frames.size() == state.frame_capacity) {
+		state.frames.pop_front();
+	}
+	state.frames.push_back({now(), 0, std::vector<System_sample>(system_count)});
+}
+
+void ECS::Profiler::Impl::end_frame() {
+	auto &state = get_state();
+	if (state.frame_capacity == 0) {
+		return;
+	}
+	auto &frame = state.frames.back();
+	frame.duration = now() - frame.begin;
+}
+
+ECS::Profiler::Impl::Sample_start ECS::Profiler::Impl::start_sample() {
+	if (!get_state().hardware_counters_enabled) {
+		return {now(), 0, 0};
+	}
+	const auto &counters = get_hardware_counters();
+	return {now(), Hardware_counters::read_counter(counters.cycles), Hardware_counters::read_counter(counters.cache_misses)};
+}
+
+//systems running at the same time write to different samples of the frame, so no lock is needed
+void ECS::Profiler::Impl::finish_sample(std::size_t system, const char *name, const Sample_start &start, std::size_t entities) {
+	const auto end = now();
+	auto &state = get_state();
+	if (state.frame_capacity == 0) {
+		return;
+	}
+	auto &sample = state.frames.back().systems[system];
+	sample = {system, name, start.time, end - start.time, ECS::Impl::Thread_pool::current_worker(), entities, 0, 0};
+	if (state.hardware_counters_enabled) {
+		const auto &counters = get_hardware_counters();
+		sample.cycles = Hardware_counters::read_counter(counters.cycles) - start.cycles;
+		sample.cache_misses = Hardware_counters::read_counter(counters.cache_misses) - start.cache_misses;
+	}
+}
+#endif
@@ -0,0 +1,106 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iosfwd>
+#include <vector>
+
+/*
+Per system frame profiler. Define ECS_PROFILE to enable it, otherwise run_systems is not instrumented and the query functions return no data.
+Every call of System::run_systems is a frame. For every system the profiler records when it ran, on which thread, for how long and how many entities it
+visited. Systems added with add_independent_system don't report entities. Every World keeps its own frames.
+With hardware counters enabled it also records CPU cycles and cache misses with perf_event_open on Linux. Counters only count the thread that runs the
+system, chunks of parallel systems that run on other threads are not included. If the counters are not available they stay 0.
+*/
+
+namespace ECS {
+	namespace Profiler {
+#ifdef ECS_PROFILE
+		constexpr bool enabled = true;
+#else
+		constexpr bool enabled = false;
+#endif
+
+		struct System_sample {
+			//position of the system in the order it was added
+			std::size_t system;
+			//the name given to add_system or nullptr
+			const char *name;
+			//nanoseconds of std::chrono::steady_clock
+			std::uint64_t begin;
+			std::uint64_t duration;
+			//0 is the thread that called run_systems, 1 to n are the workers
+			std::size_t thread;
+			std::size_t entities;
+			std::uint64_t cycles;
+			std::uint64_t cache_misses;
+		};
+		struct Frame {
+			std::uint64_t begin;
+			std::uint64_t duration;
+			//indexed by system
+			std::vector<System_sample> systems;
+		};
+
+		//the most recent frames, oldest first
+		const std::deque<Frame> &get_frames();
+		//number of frames that are kept, default 300
+		void set_frame_capacity(std::size_t capacity);
+		void clear();
+		void enable_hardware_counters(bool enable);
+		//write the kept frames in the Chrome trace event format, which chrome://tracing and Perfetto can open
+		void write_chrome_trace(std::ostream &output);
+
+		namespace Impl {
+			//counts the entities a system visits, counts nothing if the profiler is disabled
+			struct Visit_counter {
+#ifdef ECS_PROFILE
+				void add(std::size_t count = 1) {
+					visited += count;
+				}
+				std::size_t get() const {
+					return visited;
+				}
+				std::size_t visited = 0;
+#else
+				void add(std::size_t /*unused*/ = 1) {}
+				std::size_t get() const {
+					return 0;
+				}
+#endif
+			};
+
+#ifdef ECS_PROFILE
+			struct Sample_start {
+				std::uint64_t time;
+				std::uint64_t cycles;
+				std::uint64_t cache_misses;
+			};
+			void begin_frame(std::size_t system_count);
+			void end_frame();
+			Sample_start start_sample();
+			void finish_sample(std::size_t system, const char *name, const Sample_start &start, std::size_t entities);
+#else
+			inline void begin_frame(std::size_t /*unused*/) {}
+			inline void end_frame() {}
+#endif
+			//run the system function, which returns the number of visited entities, and record a sample for it
+			template <class Function>
+			void run_profiled(std::size_t system, const char *name, Function &&f) {
+#ifdef ECS_PROFILE
+				const auto start = start_sample();
+				const std::size_t entities = f();
+				finish_sample(system, name, start, entities);
+#else
+				(void)system;
+				(void)name;
+				f();
+#endif
+			}
+		} // namespace Impl
+	} // namespace Profiler
+} // namespace ECS
+
+#endif // PROFILER_H
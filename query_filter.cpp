@@ -0,0 +1 @@
+#include "query_filter.h"
\ No newline at end of file
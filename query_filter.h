@@ -0,0 +1,76 @@
+#ifndef QUERY_FILTER_H
+#define QUERY_FILTER_H
+
+#include "pool.h"
+#include "utility.h"
+
+#include <type_traits>
+
+namespace ECS {
+	/*
+	Filters narrow down the entities that System::range and the add_*system functions visit. A filter takes the place of its component in the list of
+	components, the component must exist and is accessed like the others: add_system<Changed<const HP>, Position>(f) visits the entities with an HP and a
+	Position whose HP changed since the system last ran and only reads HP.
+	Only components whose Storage_policy sets track_changes can be filtered, and only changes made through modify are noticed, see change_log.h.
+	Iterations in id order jump over blocks of 64 indexes in which nothing changed without looking at their components.
+	A system sees the changes made since the start of its previous run, including its own. Change the filtered component through get to not see it again.
+	Not<Map> skips the entities that have a Map. Optional<const Life_time> also visits the entities without a Life_time, get<Life_time> returns a pointer
+	that is nullptr for them, or a Column_reference that converts to false. Both are handled by the same cursors that join the other pools, so they cost
+	no extra search per entity. At least one component must be required.
+	Tags, empty components with Tag_storage, only filter. Required and excluded tags of a query are checked together by combining their bitmaps a word
+	at a time, so runs of 64 entity indexes without the tags are skipped at once.
+	*/
+	//the component was added or changed
+	template <class Component>
+	struct Changed {};
+	//the component was added
+	template <class Component>
+	struct Added {};
+	//the entity has no such component
+	template <class Component>
+	struct Not {};
+	//the entity may have such a component
+	template <class Component>
+	struct Optional {};
+
+	namespace Impl {
+		enum class Change_filter { none, changed, added };
+		enum class Presence { required, excluded, optional };
+		//how an entry of the list of components of System::range is accessed and filtered
+		template <class T>
+		struct Query_term {
+			//the component type with const if it is only read
+			using Access = std::remove_reference_t<T>;
+			using Component = Utility::remove_cvr<T>;
+			static constexpr Change_filter change_filter = Change_filter::none;
+			static constexpr Presence presence = Presence::required;
+		};
+		template <class T>
+		struct Query_term<Changed<T>> : Query_term<T> {
+			static_assert(tracks_changes<Utility::remove_cvr<T>>, "Changed needs a component whose Storage_policy sets track_changes");
+			static constexpr Change_filter change_filter = Change_filter::changed;
+		};
+		template <class T>
+		struct Query_term<Added<T>> : Query_term<T> {
+			static_assert(tracks_changes<Utility::remove_cvr<T>>, "Added needs a component whose Storage_policy sets track_changes");
+			static constexpr Change_filter change_filter = Change_filter::added;
+		};
+		template <class T>
+		struct Query_term<Not<T>> : Query_term<const T> {
+			static constexpr Presence presence = Presence::excluded;
+		};
+		template <class T>
+		struct Query_term<Optional<T>> : Query_term<T> {
+			static constexpr Presence presence = Presence::optional;
+		};
+		//required or excluded tags filter by their bitmaps, see tag_pool.h
+		template <class T>
+		constexpr bool is_tag_filter = is_tag_storage<typename Query_term<T>::Component> && Query_term<T>::presence != Presence::optional;
+		template <class... Terms>
+		constexpr bool has_tag_filter = (is_tag_filter<Terms> || ...);
+		template <class... Terms>
+		constexpr bool has_change_filter = ((Query_term<Terms>::change_filter != Change_filter::none) || ...);
+	} // namespace Impl
+} // namespace ECS
+
+#endif // QUERY_FILTER_H
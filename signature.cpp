@@ -0,0 +1,17 @@
+#include "signature.h"
+
+ECS::Impl::Signature ECS::Impl::Signature_table::take(Id_t id) {
+	const auto slot = slots.get(id);
+	if (slot == Sparse_index::npos || ids[slot] != id) {
+		return {};
+	}
+	const auto signature = signatures[slot];
+	//move the last signature into the hole to keep the table dense
+	signatures[slot] = signatures.back();
+	ids[slot] = ids.back();
+	slots.set(ids[slot], slot);
+	slots.erase(id);
+	signatures.pop_back();
+	ids.pop_back();
+	return signature;
+}
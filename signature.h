@@ -0,0 +1,107 @@
+#ifndef SIGNATURE_H
+#define SIGNATURE_H
+
+#include "ecs_impl.h"
+#include "sparse_index.h"
+#include "utility/asserts.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//the number of component types a program can use, define before including the ECS to change it. Every entity with components stores one bit per type.
+#ifndef ECS_MAX_COMPONENT_TYPES
+#define ECS_MAX_COMPONENT_TYPES 128
+#endif
+
+namespace ECS {
+	namespace Impl {
+		constexpr std::size_t max_component_types = ECS_MAX_COMPONENT_TYPES;
+
+		//the set of component types an entity has, bit i is set if the entity has a component with the type index i
+		struct Signature {
+			void set(std::size_t type_index) {
+				words[type_index / word_bits] |= bit(type_index);
+			}
+			void reset(std::size_t type_index) {
+				words[type_index / word_bits] &= ~bit(type_index);
+			}
+			bool test(std::size_t type_index) const {
+				return words[type_index / word_bits] & bit(type_index);
+			}
+			Signature &operator|=(const Signature &other) {
+				for (std::size_t i = 0; i < word_count; i++) {
+					words[i] |= other.words[i];
+				}
+				return *this;
+			}
+			//call f(type_index) for every set bit in ascending order
+			template <class Function>
+			void for_each(Function &&f) const {
+				for (std::size_t i = 0; i < word_count; i++) {
+					for (auto word = words[i]; word != 0; word &= word - 1) {
+						f(i * word_bits + __builtin_ctzll(word));
+					}
+				}
+			}
+
+			private:
+			using Word = std::uint64_t;
+			static constexpr std::size_t word_bits = 64;
+			static constexpr std::size_t word_count = (max_component_types + word_bits - 1) / word_bits;
+			static Word bit(std::size_t type_index) {
+				assert_fast(type_index < max_component_types);
+				return Word{1} << (type_index % word_bits);
+			}
+			std::array<Word, word_count> words{};
+		};
+
+		//the Signatures of all entities that have or had components, stored densely and looked up by Id in O(1)
+		struct Signature_table {
+			//nullptr if the entity never had components
+			Signature *find(Id_t id) {
+				const auto slot = slots.get(id);
+				return slot == Sparse_index::npos || ids[slot] != id ? nullptr : &signatures[slot];
+			}
+			Signature &get_or_add(Id_t id) {
+				const auto slot = slots.get(id);
+				if (slot != Sparse_index::npos) {
+					assert_fast(ids[slot] == id); //the entity that used the index before must have been destroyed
+					return signatures[slot];
+				}
+				assert_fast(signatures.size() < Sparse_index::npos);
+				slots.set(id, static_cast<Sparse_index::Slot_t>(signatures.size()));
+				ids.push_back(id);
+				signatures.emplace_back();
+				return signatures.back();
+			}
+			//remove the signature of id from the table and return it, an empty Signature if there was none
+			Signature take(Id_t id);
+			void reserve(std::size_t count) {
+				ids.reserve(count);
+				signatures.reserve(count);
+			}
+			//the component types any entity has
+			Signature combined() const {
+				Signature result;
+				for (const auto &signature : signatures) {
+					result |= signature;
+				}
+				return result;
+			}
+			//the ids of all entities in the table in no particular order
+			const std::vector<Id_t> &get_ids() const {
+				return ids;
+			}
+
+			private:
+			Sparse_index slots;
+			//ids[i] is the entity whose signature is signatures[i]
+			std::vector<Id_t> ids;
+			std::vector<Signature> signatures;
+		};
+	} // namespace Impl
+} // namespace ECS
+
+#endif // SIGNATURE_H
@@ -0,0 +1,414 @@
+#include "snapshot.h"
+#include "expiry.h"
+#include "trace.h"
+#include "world.h"
+
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <new>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+std::vector<ECS::Impl::Snapshot_access::Component_type> ECS::Impl::Snapshot_access::component_types;
+
+namespace {
+	struct Delta_state {
+		//deltas since earlier ticks are full copies
+		ECS::Changes::Tick_t forgotten_tick = 0;
+	};
+	ECS::Changes::Tick_t &get_forgotten_tick() {
+		return ECS::World::current().get_state<Delta_state>().forgotten_tick;
+	}
+
+	constexpr char magic[8] = {'E', 'C', 'S', 'S', 'N', 'A', 'P', '\0'};
+	constexpr char delta_magic[8] = {'E', 'C', 'S', 'D', 'E', 'L', 'T', 'A'};
+	constexpr std::uint32_t version = 1;
+	//detects snapshots written with a different byte order
+	constexpr std::uint32_t byte_order = 0x01020304;
+	constexpr std::size_t block_alignment = 64;
+
+	//the content of a file, mapped into memory where possible
+	struct File_view {
+		explicit File_view(const char *path) {
+#if defined(__unix__) || defined(__APPLE__)
+			const int file = open(path, O_RDONLY);
+			if (file < 0) {
+				return;
+			}
+			struct stat status;
+			if (fstat(file, &status) == 0 && status.st_size > 0) {
+				size = static_cast<std::size_t>(status.st_size);
+				int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+				flags |= MAP_POPULATE; //the whole file is read anyway, fault it in with one call
+#endif
+				void *memory = mmap(nullptr, size, PROT_READ, flags, file, 0);
+				if (memory != MAP_FAILED) {
+					data = static_cast<const char *>(memory);
+					mapped = true;
+				}
+			}
+			close(file);
+#else
+			std::ifstream input(path, std::ios::binary | std::ios::ate);
+			if (!input) {
+				return;
+			}
+			size = static_cast<std::size_t>(input.tellg());
+			buffer.reset(static_cast<char *>(::operator new(size, std::align_val_t{block_alignment})));
+			input.seekg(0);
+			if (input.read(buffer.get(), size)) {
+				data = buffer.get();
+			}
+#endif
+		}
+		File_view(const File_view &) = delete;
+		File_view &operator=(const File_view &) = delete;
+		~File_view() {
+#if defined(__unix__) || defined(__APPLE__)
+			if (mapped) {
+				munmap(const_cast<char *>(data), size);
+			}
+#endif
+		}
+
+		const char *data = nullptr;
+		std::size_t size = 0;
+
+		private:
+		bool mapped = false;
+		struct Aligned_delete {
+			void operator()(char *memory) const {
+				::operator delete(memory, std::align_val_t{block_alignment});
+			}
+		};
+		std::unique_ptr<char, Aligned_delete> buffer;
+	};
+
+	bool read_header(ECS::Snapshot::Reader &reader, const char (&expected_magic)[8] = magic) {
+		const auto file_magic = reader.read(sizeof expected_magic);
+		return file_magic && std::memcmp(file_magic, expected_magic, sizeof expected_magic) == 0 && reader.read<std::uint32_t>() == version &&
+			   reader.read<std::uint32_t>() == byte_order && !reader.failed;
+	}
+
+	const ECS::Impl::Snapshot_access::Component_type *find_type(ECS::Snapshot::Reader &reader) {
+		using ECS::Impl::Snapshot_access;
+		const auto name_size = reader.read<std::uint64_t>();
+		const auto name = reader.read_array<char>(name_size);
+		const auto type = std::find_if(begin(Snapshot_access::component_types), end(Snapshot_access::component_types),
+									   [name, name_size](const Snapshot_access::Component_type &component_type) {
+										   return name && component_type.name.size() == name_size && std::equal(name, name + name_size, component_type.name.data());
+									   });
+		return type == end(Snapshot_access::component_types) ? nullptr : &*type;
+	}
+} // namespace
+
+void ECS::Snapshot::Writer::write(const void *data, std::size_t size) {
+	output.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+	position += size;
+}
+
+void ECS::Snapshot::Writer::align(std::size_t alignment) {
+	static const char zeros[block_alignment] = {};
+	assert_fast(alignment <= block_alignment);
+	write(zeros, (alignment - position % alignment) % alignment);
+}
+
+void ECS::Snapshot::Writer::write(const Entity_handle &handle) {
+	write(Impl::Snapshot_access::get_id(handle));
+}
+
+void ECS::Snapshot::Writer::write_varint(std::uint64_t value) {
+	char bytes[10];
+	std::size_t size = 0;
+	for (; value >= 0x80; value >>= 7) {
+		bytes[size++] = static_cast<char>(value | 0x80);
+	}
+	bytes[size++] = static_cast<char>(value);
+	write(bytes, size);
+}
+
+const char *ECS::Snapshot::Reader::read(std::size_t size) {
+	if (failed || size > static_cast<std::size_t>(end - position)) {
+		failed = true;
+		return nullptr;
+	}
+	const auto data = position;
+	position += size;
+	return data;
+}
+
+void ECS::Snapshot::Reader::align(std::size_t alignment) {
+	read((alignment - static_cast<std::size_t>(position - begin) % alignment) % alignment);
+}
+
+std::uint64_t ECS::Snapshot::Reader::read_varint() {
+	std::uint64_t value = 0;
+	for (unsigned shift = 0; shift < 64; shift += 7) {
+		const auto byte = read(1);
+		if (!byte) {
+			return 0;
+		}
+		value |= std::uint64_t{static_cast<unsigned char>(*byte) & 0x7fu} << shift;
+		if ((*byte & 0x80) == 0) {
+			return value;
+		}
+	}
+	failed = true;
+	return 0;
+}
+
+ECS::Entity_handle ECS::Snapshot::Reader::read_handle() {
+	return Entity_handle{read<Impl::Id_t>()};
+}
+
+bool ECS::Snapshot::save(const char *path) {
+	return Impl::Snapshot_access::save(path);
+}
+
+bool ECS::Snapshot::load(const char *path, std::vector<Entity> &entities) {
+	return Impl::Snapshot_access::load(path, entities);
+}
+
+ECS::Changes::Tick_t ECS::Snapshot::write_delta(std::ostream &output, Changes::Tick_t since) {
+	return Impl::Snapshot_access::write_delta(output, since);
+}
+
+bool ECS::Snapshot::apply_delta(const char *data, std::size_t size) {
+	return Impl::Snapshot_access::apply_delta(data, size);
+}
+
+void ECS::Snapshot::forget_changes(Changes::Tick_t tick) {
+	Impl::Snapshot_access::forget_changes(tick);
+}
+
+bool ECS::Impl::Snapshot_access::save(const char *path) {
+	TRACE("snapshot save", Entity_base::world().signatures.get_ids().size());
+	const auto used = Entity_base::world().signatures.combined();
+	std::vector<const Component_type *> saved_types;
+	bool all_registered = true;
+	used.for_each([&saved_types, &all_registered](std::size_t type_index) {
+		const auto type = std::find_if(begin(component_types), end(component_types),
+									   [type_index](const Component_type &component_type) { return component_type.type_index == type_index; });
+		if (type == end(component_types)) {
+			all_registered = false;
+		} else {
+			saved_types.push_back(&*type);
+		}
+	});
+	if (!all_registered) {
+		return false;
+	}
+	std::ofstream output(path, std::ios::binary | std::ios::trunc);
+	if (!output) {
+		return false;
+	}
+	Snapshot::Writer writer{output};
+	writer.write(magic, sizeof magic);
+	writer.write(version);
+	writer.write(byte_order);
+	const auto &generations = Entity_base::world().generations;
+	writer.write(std::uint64_t{generations.size()});
+	writer.align(block_alignment);
+	writer.write(generations.data(), generations.size() * sizeof(Generation_t));
+	const auto &free_indexes = Entity_base::world().free_indexes;
+	writer.write(std::uint64_t{free_indexes.size()});
+	writer.align(block_alignment);
+	writer.write(free_indexes.data(), free_indexes.size() * sizeof(Index_t));
+	writer.write(std::uint64_t{saved_types.size()});
+	for (const auto type : saved_types) {
+		writer.write(std::uint64_t{type->name.size()});
+		writer.write(type->name.data(), type->name.size());
+		type->save(writer);
+	}
+	output.close();
+	return !output.fail();
+}
+
+bool ECS::Impl::Snapshot_access::load(const char *path, std::vector<Entity> &entities) {
+	auto &generations = Entity_base::world().generations;
+	auto &free_indexes = Entity_base::world().free_indexes;
+	//entities reserved by Staging_buffers count as existing
+	const bool empty = generations.size() == free_indexes.size() && Entity_base::world().next_index == generations.size() && Expiry::size() == 0;
+	assert_fast(empty); //no entity may exist
+	if (!empty) {
+		return false;
+	}
+	const File_view file(path);
+	if (!file.data) {
+		return false;
+	}
+	TRACE("snapshot load", file.size);
+	Snapshot::Reader reader{file.data, file.data, file.data + file.size};
+	if (!read_header(reader)) {
+		return false;
+	}
+	const auto generation_count = reader.read<std::uint64_t>();
+	reader.align(block_alignment);
+	const auto file_generations = reader.read_array<Generation_t>(generation_count);
+	const auto free_count = reader.read<std::uint64_t>();
+	reader.align(block_alignment);
+	const auto file_free_indexes = reader.read_array<Index_t>(free_count);
+	if (reader.failed || free_count > generation_count) {
+		return false;
+	}
+	std::vector<bool> is_free(generation_count);
+	for (std::size_t i = 0; i < free_count; i++) {
+		if (file_free_indexes[i] >= generation_count || is_free[file_free_indexes[i]]) {
+			return false;
+		}
+		is_free[file_free_indexes[i]] = true;
+	}
+	generations.assign(file_generations, file_generations + generation_count);
+	Entity_base::world().next_index = generation_count;
+	free_indexes.assign(file_free_indexes, file_free_indexes + free_count);
+	std::make_heap(begin(free_indexes), end(free_indexes), std::greater<>{});
+	Entity_base::world().signatures.reserve(generation_count - free_count);
+
+	const auto type_count = reader.read<std::uint64_t>();
+	for (std::uint64_t i = 0; i < type_count && !reader.failed; i++) {
+		const auto type = find_type(reader);
+		if (!type || !type->load(reader)) {
+			reset();
+			return false;
+		}
+	}
+	if (reader.failed) {
+		reset();
+		return false;
+	}
+
+	entities.reserve(entities.size() + generation_count - free_count);
+	for (std::size_t index = 0; index < generation_count; index++) {
+		if (!is_free[index]) {
+			entities.push_back(Entity{make_id(static_cast<Index_t>(index), generations[index])});
+		}
+	}
+	return true;
+}
+
+ECS::Changes::Tick_t ECS::Impl::Snapshot_access::write_delta(std::ostream &output, Changes::Tick_t since) {
+	const bool full = since == 0 || since < get_forgotten_tick();
+	std::vector<const Component_type *> written_types;
+	for (const auto &type : component_types) {
+		if (full || type.forget_removals) {
+			written_types.push_back(&type);
+		}
+	}
+	TRACE("snapshot write delta", since, written_types.size());
+	Snapshot::Writer writer{output};
+	writer.write(delta_magic, sizeof delta_magic);
+	writer.write(version);
+	writer.write(byte_order);
+	writer.write(std::uint8_t{full});
+	writer.write(std::uint64_t{written_types.size()});
+	for (const auto type : written_types) {
+		writer.write(std::uint64_t{type->name.size()});
+		writer.write(type->name.data(), type->name.size());
+		type->write_delta(writer, full ? 0 : since);
+	}
+	//changes made after this call get the new tick and go into the next delta
+	return Changes::advance_tick();
+}
+
+bool ECS::Impl::Snapshot_access::apply_delta(const char *data, std::size_t size) {
+	TRACE("snapshot apply delta", size);
+	Snapshot::Reader reader{data, data, data + size};
+	if (!read_header(reader, delta_magic)) {
+		return false;
+	}
+	const bool full = reader.read<std::uint8_t>() != 0;
+	const auto type_count = reader.read<std::uint64_t>();
+	if (reader.failed) {
+		return false;
+	}
+	if (full) {
+		Entity_base::remove_all_components();
+	}
+	for (std::uint64_t i = 0; i < type_count && !reader.failed; i++) {
+		const auto type = find_type(reader);
+		if (!type || !type->apply_delta(reader)) {
+			return false;
+		}
+	}
+	return !reader.failed;
+}
+
+void ECS::Impl::Snapshot_access::forget_changes(Changes::Tick_t tick) {
+	auto &forgotten_tick = get_forgotten_tick();
+	forgotten_tick = std::max(forgotten_tick, tick);
+	for (const auto &type : component_types) {
+		if (type.forget_removals) {
+			type.forget_removals(tick);
+		}
+	}
+}
+
+void ECS::Impl::Snapshot_access::write_ids(Snapshot::Writer &writer, const std::vector<Id_t> &ids) {
+	writer.write_varint(ids.size());
+	Id_t previous = 0;
+	for (const auto id : ids) {
+		writer.write_varint(id - previous);
+		previous = id;
+	}
+}
+
+std::vector<ECS::Impl::Id_t> ECS::Impl::Snapshot_access::read_ids(Snapshot::Reader &reader) {
+	const auto count = reader.read_varint();
+	std::vector<Id_t> ids;
+	//every id takes at least one byte, don't trust the count beyond that
+	if (count > static_cast<std::size_t>(reader.end - reader.position)) {
+		reader.failed = true;
+		return ids;
+	}
+	ids.reserve(count);
+	Id_t previous = 0;
+	for (std::uint64_t i = 0; i < count && !reader.failed; i++) {
+		const auto difference = reader.read_varint();
+		if ((i > 0 && difference == 0) || difference >= max_id - previous) {
+			reader.failed = true;
+			break;
+		}
+		previous += difference;
+		ids.push_back(previous);
+	}
+	return ids;
+}
+
+void ECS::Impl::Snapshot_access::adopt_id(Id_t id) {
+	auto &generations = Entity_base::world().generations;
+	const auto index = id_index(id);
+	Entity_base::extend_generations(index + 1);
+	if (generations[index] != id_generation(id)) {
+		//the source destroyed the entity that used the index before, the components of it that the replica still has are of types that don't track changes
+		Entity_base::remove_all_components(make_id(index, generations[index]));
+		generations[index] = id_generation(id);
+	}
+}
+
+bool ECS::Impl::Snapshot_access::valid_ids(const Id_t *ids, std::size_t count, bool sparse) {
+	const auto &generations = Entity_base::world().generations;
+	for (std::size_t i = 0; i < count; i++) {
+		const auto index = id_index(ids[i]);
+		if (index >= generations.size() || generations[index] != id_generation(ids[i])) {
+			return false;
+		}
+		if (!sparse && i > 0 && ids[i - 1] >= ids[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void ECS::Impl::Snapshot_access::reset() {
+	Entity_base::remove_all_components();
+	Entity_base::world().generations.clear();
+	Entity_base::world().free_indexes.clear();
+	Entity_base::world().next_index = 0;
+}
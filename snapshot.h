@@ -0,0 +1,377 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "change_log.h"
+#include "column_pool.h"
+#include "ecs_impl.h"
+#include "entity.h"
+#include "entity_handle.h"
+#include "pool.h"
+#include "system_base.h"
+#include "utility.h"
+#include "utility/asserts.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <utility>
+#include <type_traits>
+#include <vector>
+
+/*
+Binary snapshot of all entities and components of the current World to restart with the same world quickly.
+Component types are matched by name, so every type that has components must be registered with Snapshot::register_component in the program that saves
+and in the one that loads. Ids and trivially copyable components are written as raw blocks aligned to 64 bytes, Column_storage writes one block per
+column. Loading maps the file and copies the blocks into the pools, the only work per component is updating the id to slot index and the signature.
+Components that are not trivially copyable need a Snapshot_serializer.
+Entity ids including generations are kept, so Entity_handles stored in components still refer to the same entities after loading.
+The format is the memory layout of the platform, a snapshot can only be loaded by a program built for the same platform with the same components.
+*/
+
+namespace ECS {
+	namespace Snapshot {
+		//appends bytes to the snapshot file
+		struct Writer {
+			void write(const void *data, std::size_t size);
+			template <class T>
+			void write(const T &value) {
+				static_assert(std::is_trivially_copyable<T>::value, "Write the members of T one by one");
+				write(&value, sizeof value);
+			}
+			//handles stay valid because loading keeps entity ids
+			void write(const Entity_handle &handle);
+			//7 bits per byte, small numbers take less space
+			void write_varint(std::uint64_t value);
+			//pad with zeros up to the next multiple of alignment
+			void align(std::size_t alignment);
+
+			std::ostream &output;
+			std::uint64_t position = 0;
+		};
+		//reads bytes from a loaded snapshot. Reading past the end sets failed and returns zeros or nullptr.
+		struct Reader {
+			//size bytes of the snapshot or nullptr
+			const char *read(std::size_t size);
+			template <class T>
+			T read() {
+				static_assert(std::is_trivially_copyable<T>::value, "Read the members of T one by one");
+				std::aligned_storage_t<sizeof(T), alignof(T)> value{};
+				if (const auto data = read(sizeof(T))) {
+					std::copy(data, data + sizeof(T), reinterpret_cast<char *>(&value));
+				}
+				return *reinterpret_cast<const T *>(&value);
+			}
+			std::uint64_t read_varint();
+			//count elements of T, nullptr if the snapshot is too short
+			template <class T>
+			const T *read_array(std::uint64_t count) {
+				if (count > static_cast<std::uint64_t>(end - position) / sizeof(T)) {
+					failed = true;
+					return nullptr;
+				}
+				return reinterpret_cast<const T *>(read(count * sizeof(T)));
+			}
+			Entity_handle read_handle();
+			void align(std::size_t alignment);
+
+			const char *begin;
+			const char *position;
+			const char *end;
+			bool failed = false;
+		};
+	} // namespace Snapshot
+
+	//specialize to store components that are not trivially copyable in snapshots
+	template <class Component>
+	struct Snapshot_serializer;
+	/* Example:
+	template <>
+	struct ECS::Snapshot_serializer<Name> {
+		static void save(const Name &name, ECS::Snapshot::Writer &writer) {
+			writer.write(name.text.size());
+			writer.write(name.text.data(), name.text.size());
+		}
+		static Name load(ECS::Snapshot::Reader &reader) {
+			const auto size = reader.read<std::size_t>();
+			const auto text = reader.read(size);
+			return Name{text ? std::string(text, size) : std::string{}};
+		}
+	};
+	Entity_handle is not trivially copyable, components that store handles write them with Writer::write(handle) and Reader::read_handle.
+	*/
+
+	namespace Impl {
+		template <class Component, class = void>
+		constexpr bool has_snapshot_serializer = false;
+		template <class Component>
+		constexpr bool has_snapshot_serializer<Component, std::void_t<decltype(sizeof(Snapshot_serializer<Component>))>> = true;
+	} // namespace Impl
+	namespace Snapshot {
+		//make a component type part of snapshots. The name identifies the type in the file, it defaults to the demangled type name.
+		template <class Component>
+		void register_component(std::string name = Utility::type_name<Component>());
+		//write all entities and components to a file
+		//returns false if the file could not be written or an entity has a component of a type that is not registered
+		bool save(const char *path);
+		//restore a snapshot, no entity may exist. entities receives the entities that were alive when the snapshot was saved, in id order, including the
+		//ones that were owned by the expiry subsystem.
+		//returns false and leaves no entity if the file cannot be read, is not a snapshot or has components of types that are not registered
+		bool load(const char *path, std::vector<Entity> &entities);
+
+		/*
+		Deltas replicate a world to replicas that only change through deltas and never create entities themselves.
+		A delta holds the ids of removed components and the ids and values of added and changed components of the component types whose
+		Storage_policy sets track_changes, see change_log.h. Changes are found through modify and through adding and removing components, changing a
+		component through get is not noticed. Ids are sorted and delta encoded, the replica applies each type with one merge.
+		A delta since tick 0 is a full copy of all registered component types, applying it replaces all components of the replica.
+		*/
+		//write the changes since the tick that the previous call for the same replica returned, or everything if since is 0 or older than the last
+		//forget_changes. Returns the tick to pass next time, advances the current tick so later changes are not mixed with the written ones.
+		Changes::Tick_t write_delta(std::ostream &output, Changes::Tick_t since);
+		//apply a delta written by write_delta, returns false if it is not a delta or has components of types that are not registered.
+		//The replica must have the same registered component types. Entities of the replica get the ids of the entities of the source.
+		bool apply_delta(const char *data, std::size_t size);
+		//free the removals recorded before tick, replicas that are further behind get a full copy
+		void forget_changes(Changes::Tick_t tick);
+	} // namespace Snapshot
+
+	namespace Impl {
+		struct Snapshot_access {
+			struct Component_type {
+				std::string name;
+				std::size_t type_index;
+				void (*save)(Snapshot::Writer &writer);
+				bool (*load)(Snapshot::Reader &reader);
+				//nullptr if the type does not track changes and is only part of full deltas
+				void (*forget_removals)(Changes::Tick_t tick);
+				void (*write_delta)(Snapshot::Writer &writer, Changes::Tick_t since);
+				bool (*apply_delta)(Snapshot::Reader &reader);
+			};
+			//shared by all worlds, register types before worlds run on different threads
+			static std::vector<Component_type> component_types;
+
+			template <class Component>
+			static void register_component(std::string name) {
+				static_assert(std::is_trivially_copyable<Component>::value || is_column_storage<Component> || has_snapshot_serializer<Component>,
+							  "Specialize Snapshot_serializer for components that are not trivially copyable");
+				const auto type_index = Entity_base::type_index<Component>();
+				assert_fast(std::none_of(begin(component_types), end(component_types), [&name, type_index](const Component_type &type) {
+					return type.name == name || type.type_index == type_index;
+				})); //every type needs a unique name
+				component_types.push_back({std::move(name), type_index, save_pool<Component>, load_pool<Component>,
+										   tracks_changes<Component> ? forget_removals<Component> : nullptr, write_delta<Component>, apply_delta<Component>});
+			}
+			static bool save(const char *path);
+			static bool load(const char *path, std::vector<Entity> &entities);
+			static Changes::Tick_t write_delta(std::ostream &output, Changes::Tick_t since);
+			static bool apply_delta(const char *data, std::size_t size);
+			static void forget_changes(Changes::Tick_t tick);
+			static Id_t get_id(const Entity_handle &handle) {
+				return handle.id;
+			}
+
+			private:
+			static constexpr std::size_t block_alignment = 64;
+
+			template <class Component>
+			static void save_pool(Snapshot::Writer &writer) {
+				auto &pool = System::get_pool<Component>();
+				const std::uint64_t count = pool.size();
+				writer.write(std::uint64_t{sizeof(Component)});
+				writer.write(count);
+				writer.align(block_alignment);
+				writer.write(pool.ids.data(), count * sizeof(Id_t));
+				if constexpr (is_tag_storage<Component>) {
+					//the ids are all there is
+				} else if constexpr (is_column_storage<Component>) {
+					pool.for_each_column([&writer, count](auto, auto &column) {
+						writer.align(block_alignment);
+						writer.write(column.data(), count * sizeof(column[0]));
+					});
+				} else if constexpr (std::is_trivially_copyable<Component>::value) {
+					writer.align(block_alignment);
+					writer.write(pool.components.data(), count * sizeof(Component));
+				} else {
+					for (const auto &component : pool.components) {
+						Snapshot_serializer<Component>::save(component, writer);
+					}
+				}
+			}
+			template <class Component>
+			static bool load_pool(Snapshot::Reader &reader) {
+				using Pool_type = Pool<Component>;
+				auto &pool = System::get_pool<Component>();
+				const auto component_size = reader.read<std::uint64_t>();
+				const auto count = reader.read<std::uint64_t>();
+				reader.align(block_alignment);
+				const auto ids = reader.read_array<Id_t>(count);
+				if (reader.failed || component_size != sizeof(Component) || pool.size() != 0 || !valid_ids(ids, count, Pool_type::sparse)) {
+					return false;
+				}
+				if constexpr (is_tag_storage<Component>) {
+					pool.append(ids, count, [](std::size_t) { return Component{}; });
+				} else if constexpr (is_column_storage<Component>) {
+					std::array<const char *, Pool_type::column_count> columns;
+					pool.for_each_column([&reader, &columns, count](auto index, auto &column) {
+						reader.align(block_alignment);
+						columns[index] = reinterpret_cast<const char *>(reader.read_array<std::remove_reference_t<decltype(column[0])>>(count));
+					});
+					if (reader.failed) {
+						return false;
+					}
+					pool.append(ids, count, [&columns](std::size_t i) {
+						return Pool_type::make_from_fields([&columns, i](auto index) -> decltype(auto) {
+							return reinterpret_cast<const typename Pool_type::template Field_type<index> *>(columns[index])[i];
+						});
+					});
+				} else if constexpr (std::is_trivially_copyable<Component>::value) {
+					reader.align(block_alignment);
+					const auto components = reader.read_array<Component>(count);
+					if (reader.failed) {
+						return false;
+					}
+					pool.append(ids, count, [components](std::size_t i) -> const Component & { return components[i]; });
+				} else {
+					pool.append(ids, count, [&reader](std::size_t) { return Snapshot_serializer<Component>::load(reader); });
+				}
+				const auto type_index = Entity_base::type_index<Component>();
+				for (std::size_t i = 0; i < count; i++) {
+					Entity_base::world().signatures.get_or_add(ids[i]).set(type_index);
+				}
+				return !reader.failed;
+			}
+			template <class Component>
+			static void forget_removals(Changes::Tick_t tick) {
+				System::get_pool<Component>().changes.forget_removals(tick);
+			}
+			//since is 0 for a full copy
+			template <class Component>
+			static void write_delta(Snapshot::Writer &writer, Changes::Tick_t since) {
+				auto &pool = System::get_pool<Component>();
+				std::vector<Id_t> removed;
+				std::vector<Id_t> added;
+				std::vector<Id_t> changed;
+				if (since == 0) {
+					added.assign(begin(pool.ids), end(pool.ids) - 1);
+				} else if constexpr (tracks_changes<Component>) {
+					//components that exist again were added after the removal and are sent as added
+					pool.changes.for_each_removal(since, [&pool, &removed](Id_t id) {
+						if (pool.find(id) == pool.npos) {
+							removed.push_back(id);
+						}
+					});
+					pool.changes.for_each_change(since, [&pool, &added, &changed](Id_t id, bool is_added) {
+						if (pool.find(id) != pool.npos) {
+							(is_added ? added : changed).push_back(id);
+						}
+					});
+				}
+				for (auto ids : {&removed, &added, &changed}) {
+					std::sort(begin(*ids), end(*ids));
+					ids->erase(std::unique(begin(*ids), end(*ids)), end(*ids));
+					write_ids(writer, *ids);
+				}
+				for (auto ids : {&added, &changed}) {
+					for (const auto id : *ids) {
+						write_component<Component>(writer, pool.find(id));
+					}
+				}
+			}
+			template <class Component>
+			static bool apply_delta(Snapshot::Reader &reader) {
+				auto &pool = System::get_pool<Component>();
+				auto removed = read_ids(reader);
+				const auto added = read_ids(reader);
+				const auto changed = read_ids(reader);
+				if (reader.failed) {
+					return false;
+				}
+				removed.erase(std::remove_if(begin(removed), end(removed), [&pool](Id_t id) { return pool.find(id) == pool.npos; }), end(removed));
+				Entity_base::remove_from_signatures<Component>(removed);
+				pool.erase_sorted(removed.data(), removed.size());
+				//components the replica already has are overwritten, the others are merged into the pool in one pass
+				std::vector<std::pair<Id_t, Component>> inserted;
+				for (auto ids : {&added, &changed}) {
+					for (const auto id : *ids) {
+						auto component = read_component<Component>(reader);
+						if (reader.failed) {
+							return false;
+						}
+						adopt_id(id);
+						const auto slot = pool.find(id);
+						if (slot == pool.npos) {
+							inserted.emplace_back(id, std::move(component));
+						} else {
+							if constexpr (is_tag_storage<Component>) {
+								//nothing to overwrite
+							} else if constexpr (is_column_storage<Component>) {
+								pool.store(slot, component);
+							} else {
+								pool.components[slot] = std::move(component);
+							}
+							if constexpr (tracks_changes<Component>) {
+								pool.changes.changed(id);
+							}
+						}
+					}
+				}
+				std::sort(begin(inserted), end(inserted), [](const auto &lhs, const auto &rhs) { return lhs.first < rhs.first; });
+				std::vector<Id_t> inserted_ids;
+				inserted_ids.reserve(inserted.size());
+				for (const auto &entry : inserted) {
+					inserted_ids.push_back(entry.first);
+				}
+				pool.insert_sorted(inserted);
+				Entity_base::add_to_signatures<Component>(inserted_ids);
+				return true;
+			}
+			template <class Component>
+			static void write_component(Snapshot::Writer &writer, std::size_t slot) {
+				auto &pool = System::get_pool<Component>();
+				if constexpr (is_tag_storage<Component>) {
+					static_cast<void>(writer);
+					static_cast<void>(slot);
+				} else if constexpr (is_column_storage<Component>) {
+					pool.for_each_column([&writer, slot](auto, auto &column) { writer.write(column[slot]); });
+				} else if constexpr (std::is_trivially_copyable<Component>::value) {
+					writer.write(pool.components[slot]);
+				} else {
+					Snapshot_serializer<Component>::save(pool.components[slot], writer);
+				}
+			}
+			template <class Component>
+			static Component read_component(Snapshot::Reader &reader) {
+				if constexpr (is_tag_storage<Component>) {
+					static_cast<void>(reader);
+					return Component{};
+				} else if constexpr (is_column_storage<Component>) {
+					return Pool<Component>::make_from_fields(
+						[&reader](auto index) { return reader.read<typename Pool<Component>::template Field_type<index>>(); });
+				} else if constexpr (std::is_trivially_copyable<Component>::value) {
+					return reader.read<Component>();
+				} else {
+					return Snapshot_serializer<Component>::load(reader);
+				}
+			}
+			//sorted ids as the count and the differences between neighbors
+			static void write_ids(Snapshot::Writer &writer, const std::vector<Id_t> &ids);
+			static std::vector<Id_t> read_ids(Snapshot::Reader &reader);
+			//make id alive in a replica, removes what is left of the entity that had the index before
+			static void adopt_id(Id_t id);
+			//ids must belong to the loaded entities and be sorted unless the pool is a sparse set
+			static bool valid_ids(const Id_t *ids, std::size_t count, bool sparse);
+			//destroy everything that was loaded before a load failed
+			static void reset();
+		};
+	} // namespace Impl
+
+	template <class Component>
+	void Snapshot::register_component(std::string name) {
+		Impl::Snapshot_access::register_component<Utility::remove_cvr<Component>>(std::move(name));
+	}
+} // namespace ECS
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,98 @@
+#ifndef SPARSE_INDEX_H
+#define SPARSE_INDEX_H
+
+#include "ecs_impl.h"
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace ECS {
+	namespace Impl {
+		/*
+		Maps Ids to positions in a dense array in O(1).
+		Ids are looked up by their index, so only one generation of an index can be in the map and the caller has to compare the id at the returned
+		position to detect ids of destroyed entities.
+		The map is split into pages that are only allocated when an index in their range is set and freed again when their last index is erased, so
+		memory stays proportional to the index ranges in use, which are bounded by the number of live entities.
+		*/
+		struct Sparse_index {
+			using Slot_t = std::uint32_t;
+			static constexpr Slot_t npos = std::numeric_limits<Slot_t>::max();
+
+			//get the slot of an id or npos if the id is not in the index
+			Slot_t get(Id_t id) const {
+				const auto index = id_index(id);
+				const auto page = index >> page_bits;
+				if (page >= pages.size() || !pages[page]) {
+					return npos;
+				}
+				return pages[page]->slots[index & page_mask];
+			}
+			bool contains(Id_t id) const {
+				return get(id) != npos;
+			}
+			//start loading the entry of id into the cache
+			void prefetch(Id_t id) const {
+				const auto page = id_index(id) >> page_bits;
+				if (page < pages.size() && pages[page]) {
+					__builtin_prefetch(&pages[page]->slots[id_index(id) & page_mask]);
+				}
+			}
+			//insert id or overwrite its slot if it is already in the index
+			void set(Id_t id, Slot_t slot) {
+				const auto index = id_index(id);
+				auto &page = get_page(index >> page_bits);
+				auto &entry = page.slots[index & page_mask];
+				if (entry == npos) {
+					page.count++;
+				}
+				entry = slot;
+			}
+			//change the slot of an id that is already in the index
+			void move(Id_t id, Slot_t slot) {
+				const auto index = id_index(id);
+				pages[index >> page_bits]->slots[index & page_mask] = slot;
+			}
+			//remove id from the index, id must be in the index
+			void erase(Id_t id) {
+				const auto index = id_index(id);
+				const auto page = index >> page_bits;
+				auto &entry = pages[page]->slots[index & page_mask];
+				entry = npos;
+				if (--pages[page]->count == 0) {
+					pages[page].reset();
+				}
+			}
+			void clear() {
+				pages.clear();
+			}
+
+			private:
+			static constexpr unsigned page_bits = 12;
+			static constexpr Index_t page_size = Index_t{1} << page_bits;
+			static constexpr Index_t page_mask = page_size - 1;
+			struct Page {
+				Page() {
+					slots.fill(npos);
+				}
+				std::array<Slot_t, page_size> slots;
+				Slot_t count = 0;
+			};
+			Page &get_page(Index_t page) {
+				if (page >= pages.size()) {
+					pages.resize(page + 1);
+				}
+				if (!pages[page]) {
+					pages[page] = std::make_unique<Page>();
+				}
+				return *pages[page];
+			}
+			std::vector<std::unique_ptr<Page>> pages;
+		};
+	} // namespace Impl
+} // namespace ECS
+
+#endif // SPARSE_INDEX_H
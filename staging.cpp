@@ -0,0 +1,35 @@
+#include "staging.h"
+#include "trace.h"
+
+#include <algorithm>
+
+std::vector<ECS::Entity> ECS::Staging_buffer::merge() {
+	auto &world = World::current();
+	std::vector<std::unique_ptr<Impl::Staged_batch>> batches;
+	for (auto batch = world.staged_batches.exchange(nullptr, std::memory_order_acquire); batch; batch = batch->next) {
+		batches.emplace_back(batch);
+	}
+	//the stack holds the newest batch first
+	std::reverse(begin(batches), end(batches));
+	TRACE("merge staged", batches.size());
+	Command_buffer commands;
+	std::size_t created_count = 0;
+	std::size_t index_count = 0;
+	for (auto &batch : batches) {
+		for (auto id : batch->created) {
+			index_count = std::max<std::size_t>(index_count, Impl::id_index(id) + 1);
+		}
+		created_count += batch->created.size();
+		commands.append(std::move(batch->commands));
+	}
+	Impl::Entity_base::extend_generations(index_count);
+	commands.flush();
+	std::vector<Entity> created;
+	created.reserve(created_count);
+	for (auto &batch : batches) {
+		for (auto id : batch->created) {
+			created.push_back(Entity{id});
+		}
+	}
+	return created;
+}
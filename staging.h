@@ -0,0 +1,90 @@
+#ifndef STAGING_H
+#define STAGING_H
+
+#include "command_buffer.h"
+#include "ecs_impl.h"
+#include "entity.h"
+#include "entity_handle.h"
+#include "world.h"
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace ECS {
+	namespace Impl {
+		//what one Staging_buffer recorded between two submits
+		struct Staged_batch {
+			Command_buffer commands;
+			std::vector<Id_t> created;
+			Staged_batch *next = nullptr;
+		};
+	} // namespace Impl
+	/*
+	Creates entities and adds components from threads other than the one that runs the world, such as network or AI threads, while the simulation runs.
+	Every producer thread uses its own Staging_buffer. create reserves an id with one atomic increment and emplace only appends to the buffer, so producers
+	never wait for the simulation and never touch the pools, generations or signatures of the world.
+	submit hands the recorded batch to the world with a lock free push. Staging_buffer::merge, called by the thread that runs the world between frames,
+	applies all submitted batches with one sorted pass over each pool like Command_buffer::flush and hands out the created entities.
+	Until they are merged, created entities don't exist for the rest of the API. Producers must not use their handles for anything but emplace.
+	Merge before saving a Snapshot, and don't load or reset the world while producers are creating entities.
+	*/
+	struct Staging_buffer {
+		explicit Staging_buffer(World &world = World::current())
+			: owner(&world) {}
+		Staging_buffer(Staging_buffer &&) = default;
+		Staging_buffer &operator=(Staging_buffer &&other) {
+			submit();
+			owner = other.owner;
+			batch = std::move(other.batch);
+			return *this;
+		}
+		//submits what has not been submitted yet
+		~Staging_buffer() {
+			submit();
+		}
+		//a new entity that exists once its batch is merged
+		Entity_handle create() {
+			const auto id = Impl::make_id(Impl::Entity_base::reserve_index(*owner), 0);
+			get_batch().created.push_back(id);
+			return Entity_handle{id};
+		}
+		//the entity is created by a Staging_buffer of the same world or an existing entity. Producers cannot know if an existing entity is destroyed
+		//before the batch is merged, merge then drops the component like Command_buffer::flush does.
+		template <class Component, class... Args>
+		void emplace(Entity_handle entity, Args &&... args) {
+			get_batch().commands.template record_emplace<Component>(entity.id, std::forward<Args>(args)...);
+		}
+		template <class Component>
+		void add(Entity_handle entity, Component &&c) {
+			emplace<Utility::remove_cvr<Component>>(entity, std::forward<Component>(c));
+		}
+		//makes everything recorded since the last submit visible to the next merge, never blocks
+		void submit() {
+			if (!batch) {
+				return;
+			}
+			auto &head = owner->staged_batches;
+			batch->next = head.load(std::memory_order_relaxed);
+			while (!head.compare_exchange_weak(batch->next, batch.get(), std::memory_order_release, std::memory_order_relaxed)) {
+			}
+			batch.release();
+		}
+		//applies the submitted batches of the current world in submission order per producer and returns the entities they created
+		static std::vector<Entity> merge();
+
+		private:
+		Impl::Staged_batch &get_batch() {
+			if (!batch) {
+				batch = std::make_unique<Impl::Staged_batch>();
+			}
+			return *batch;
+		}
+
+		World *owner;
+		std::unique_ptr<Impl::Staged_batch> batch;
+	};
+} // namespace ECS
+
+#endif // STAGING_H
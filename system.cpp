@@ -1,4 +1,199 @@
 #include "system.h"
+#include "change_log.h"
+#include "command_buffer.h"
+#include "expiry.h"
+#include "profiler.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include "world.h"
 
-std::vector<void (*)()> ECS::System::function_pointer_systems;
-std::vector<std::function<void()>> ECS::System::function_systems;
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+struct ECS::System::State {
+	std::vector<Registered_system> systems;
+	std::unique_ptr<Impl::Thread_pool> thread_pool;
+	//command_buffers[i] is used by thread pool worker i, command_buffers[0] by all other threads
+	std::vector<Command_buffer> command_buffers = std::vector<Command_buffer>(1);
+	//dependents[i] are the systems that must wait for system i, dependency_counts[i] is how many systems system i waits for
+	struct Schedule {
+		std::vector<std::vector<std::size_t>> dependents;
+		std::vector<std::size_t> dependency_counts;
+	} schedule;
+	//one entry per observed component type
+	struct Observers {
+		const void *type;
+		Collect_function collect;
+		std::vector<Observer> on_add;
+		std::vector<Observer> on_remove;
+	};
+	std::vector<Observers> observers;
+	//true while run_systems runs the systems
+	bool running_systems = false;
+};
+
+namespace {
+	ECS::System::State &get_state() {
+		return ECS::World::current().get_state<ECS::System::State>();
+	}
+
+	ECS::Impl::Thread_pool &get_thread_pool() {
+		auto &state = get_state();
+		if (!state.thread_pool) {
+			ECS::System::set_worker_count(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+		}
+		return *state.thread_pool;
+	}
+} // namespace
+
+std::vector<ECS::System::Registered_system> &ECS::System::get_systems() {
+	return get_state().systems;
+}
+
+void ECS::System::run_systems() {
+	auto &pool = get_thread_pool();
+	auto &state = get_state();
+	const auto &systems = state.systems;
+	auto &schedule = state.schedule;
+	Profiler::Impl::begin_frame(systems.size());
+	state.running_systems = true;
+	if (pool.worker_count() == 0) {
+		for (std::size_t i = 0; i < systems.size(); i++) {
+			run_system(i);
+		}
+	} else {
+		if (schedule.dependency_counts.size() != systems.size()) { //systems have been added, update the schedule
+			const auto conflict = [](const Registered_system &lhs, const Registered_system &rhs) {
+				if (lhs.exclusive || rhs.exclusive) {
+					return true;
+				}
+				return std::any_of(begin(lhs.accesses), end(lhs.accesses), [&rhs](const Access &lhs_access) {
+					return std::any_of(begin(rhs.accesses), end(rhs.accesses), [&lhs_access](const Access &rhs_access) {
+						return lhs_access.type == rhs_access.type && (lhs_access.write || rhs_access.write);
+					});
+				});
+			};
+			schedule.dependents.assign(systems.size(), {});
+			schedule.dependency_counts.assign(systems.size(), 0);
+			for (std::size_t later = 0; later < systems.size(); later++) {
+				for (std::size_t earlier = 0; earlier < later; earlier++) {
+					if (conflict(systems[earlier], systems[later])) {
+						schedule.dependents[earlier].push_back(later);
+						schedule.dependency_counts[later]++;
+					}
+				}
+			}
+		}
+		std::unique_ptr<std::atomic<std::size_t>[]> waiting_for(new std::atomic<std::size_t>[systems.size()]);
+		for (std::size_t i = 0; i < systems.size(); i++) {
+			waiting_for[i] = schedule.dependency_counts[i];
+		}
+		std::atomic<std::size_t> unfinished{systems.size()};
+		struct Runner {
+			void operator()(std::size_t index) const {
+				run_system(index);
+				for (auto dependent : dependents[index]) {
+					if (--waiting_for[dependent] == 0) {
+						pool.submit([*this, dependent] { (*this)(dependent); });
+					}
+				}
+				unfinished--;
+			}
+			Impl::Thread_pool &pool;
+			const std::vector<std::vector<std::size_t>> &dependents;
+			std::atomic<std::size_t> *waiting_for;
+			std::atomic<std::size_t> &unfinished;
+		} runner{pool, schedule.dependents, waiting_for.get(), unfinished};
+		for (std::size_t i = 0; i < systems.size(); i++) {
+			if (schedule.dependency_counts[i] == 0) {
+				pool.submit([runner, i] { runner(i); });
+			}
+		}
+		pool.help_until([&unfinished] { return unfinished == 0; });
+	}
+	state.running_systems = false;
+	Profiler::Impl::end_frame();
+	auto &command_buffers = state.command_buffers;
+	auto &command_buffer = command_buffers.front();
+	for (auto it = begin(command_buffers) + 1; it != end(command_buffers); ++it) {
+		command_buffer.append(std::move(*it));
+	}
+	command_buffer.flush();
+	Expiry::end_frame();
+	notify_observers();
+	Changes::advance_tick();
+}
+
+void ECS::System::notify_observers() {
+	auto &state = get_state();
+	//observers may change any component, so they must not run at the same time as systems
+	assert_fast(!state.running_systems && Impl::Thread_pool::current_worker() == 0);
+	std::vector<Entity_handle> added;
+	std::vector<Entity_handle> removed;
+	//observers may add observers, which can move the entries
+	auto &observers = state.observers;
+	for (std::size_t type = 0; type < observers.size(); type++) {
+		observers[type].collect(added, removed);
+		for (std::size_t i = 0; !removed.empty() && i < observers[type].on_remove.size(); i++) {
+			auto observer = observers[type].on_remove[i];
+			observer(removed);
+		}
+		for (std::size_t i = 0; !added.empty() && i < observers[type].on_add.size(); i++) {
+			auto observer = observers[type].on_add[i];
+			observer(added);
+		}
+	}
+}
+
+void ECS::System::add_observer(const void *type, Collect_function collect, Observer f, bool on_add) {
+	auto &observers = get_state().observers;
+	auto it = std::find_if(begin(observers), end(observers), [type](const State::Observers &entry) { return entry.type == type; });
+	if (it == end(observers)) {
+		observers.push_back({type, collect, {}, {}});
+		it = end(observers) - 1;
+	}
+	(on_add ? it->on_add : it->on_remove).push_back(std::move(f));
+}
+
+void ECS::System::run_system(std::size_t index) {
+	const auto &systems = get_state().systems;
+	TRACE("system begin", index);
+	Profiler::Impl::run_profiled(index, systems[index].name, systems[index].function);
+	TRACE("system end", index);
+}
+
+void ECS::System::run_in_parallel(std::size_t chunk_count, const std::function<void(std::size_t)> &run_chunk) {
+	auto &pool = get_thread_pool();
+	if (pool.worker_count() == 0 || chunk_count < 2) {
+		for (std::size_t chunk = 0; chunk < chunk_count; chunk++) {
+			run_chunk(chunk);
+		}
+		return;
+	}
+	std::atomic<std::size_t> unfinished{chunk_count};
+	for (std::size_t chunk = 0; chunk < chunk_count; chunk++) {
+		pool.submit([&run_chunk, &unfinished, chunk] {
+			run_chunk(chunk);
+			unfinished--;
+		});
+	}
+	pool.help_until([&unfinished] { return unfinished == 0; });
+}
+
+void ECS::System::set_worker_count(std::size_t count) {
+	auto &state = get_state();
+	auto &thread_pool = state.thread_pool;
+	auto &command_buffers = state.command_buffers;
+	thread_pool.reset();
+	thread_pool = std::make_unique<Impl::Thread_pool>(count, [&world = World::current()] { World::make_current(world); });
+	for (auto i = count + 1; i < command_buffers.size(); i++) { //keep changes recorded by workers that are removed
+		command_buffers.front().append(std::move(command_buffers[i]));
+	}
+	command_buffers.resize(count + 1);
+}
+
+ECS::Command_buffer &ECS::System::get_command_buffer() {
+	return get_state().command_buffers[Impl::Thread_pool::current_worker()];
+}
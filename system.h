@@ -2,8 +2,16 @@
 #define SYSTEM_H
 
 #include "entity_handle.h"
+#include "group.h"
 #include "system_base.h"
 #include "system_iterator.h"
+#include "utility.h"
+
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 //get an Entity_handle for an Entity that owns the given component
 //the given component must be owned by an Entity, otherwise it is UB!
@@ -17,11 +25,74 @@ ECS::Entity_handle ECS::System::component_to_entity_handle(const Component &comp
 	return Entity_handle{get_ids<Component>()[index]};
 }
 
+template <class Component>
+void ECS::System::lookup(const Entity_handle *entities, std::size_t count, Component **result) {
+	static_assert(!Impl::is_column_storage<Component>, "Components with Column_storage have no address, use Entity_handle::get");
+	auto &pool = get_pool<Component>();
+	constexpr std::size_t prefetch_distance = 8;
+	for (std::size_t i = 0; i < count; i++) {
+		if (i + prefetch_distance < count) {
+			pool.slots.prefetch(entities[i + prefetch_distance].id);
+		}
+		const auto slot = pool.find(entities[i].id);
+		result[i] = slot == pool.npos ? nullptr : &pool.components[slot];
+	}
+}
+
+template <class Component>
+void ECS::System::on_add(Observer f) {
+	get_pool<Component>().events.observed = true;
+	add_observer(Impl::type_key<Utility::remove_cvr<Component>>(), collect_events<Utility::remove_cvr<Component>>, std::move(f), true);
+}
+
+template <class Component>
+void ECS::System::on_remove(Observer f) {
+	get_pool<Component>().events.observed = true;
+	add_observer(Impl::type_key<Utility::remove_cvr<Component>>(), collect_events<Utility::remove_cvr<Component>>, std::move(f), false);
+}
+
+template <class Component>
+void ECS::System::collect_events(std::vector<Entity_handle> &added, std::vector<Entity_handle> &removed) {
+	auto &pool = get_pool<Component>();
+	std::vector<Impl::Id_t> added_ids;
+	std::vector<Impl::Id_t> removed_ids;
+	pool.events.take([&pool](Impl::Id_t id) { return pool.find(id) != pool.npos; }, added_ids, removed_ids);
+	added.clear();
+	removed.clear();
+	for (const auto id : added_ids) {
+		added.emplace_back(id);
+	}
+	for (const auto id : removed_ids) {
+		removed.emplace_back(id);
+	}
+}
+
+template <auto... fields, class Function>
+void ECS::System::for_each_column(Function &&f) {
+	using Component = typename Utility::Member_pointer_traits<typename Utility::Type_list<decltype(fields)...>::template nth<0>>::Class;
+	static_assert((std::is_same<typename Utility::Member_pointer_traits<decltype(fields)>::Class, Component>::value && ...),
+				  "All fields must belong to the same component");
+	auto &pool = get_pool<Component>();
+	const auto count = pool.size();
+	const auto columns = std::make_tuple(Utility::assume_aligned<Impl::Pool<Component>::column_alignment>(pool.template column<fields>().data())...);
+	std::apply(
+		[&f, count](auto *... column) {
+			VECTORIZE_LOOP
+			for (std::size_t i = 0; i < count; i++) {
+				f(column[i]...);
+			}
+		},
+		columns);
+}
+
 template <class... Components>
 ECS::System_iterator<Components...> ECS::System::range() {
-	System_iterator<Components...> si;
-	si.advance(0);
-	return si;
+	return {};
+}
+
+template <class... Components>
+ECS::System_iterator<Components...> ECS::System::range(Changes::Tick_t since) {
+	return System_iterator<Components...>{since};
 }
 
 template <class... Components>
@@ -31,9 +102,7 @@ ECS::System::Range<Components...> ECS::System::get_range() {
 
 template <class... Components>
 ECS::System_iterator<Components...> ECS::System::Range<Components...>::begin() {
-	System_iterator<Components...> si;
-	si.advance(0);
-	return si;
+	return {};
 }
 
 template <class... Components>
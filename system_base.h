@@ -1,22 +1,39 @@
 #ifndef SYSTEM_BASE_H
 #define SYSTEM_BASE_H
 
+#include "change_log.h"
+#include "column_pool.h"
 #include "ecs_impl.h"
+#include "pool.h"
+#include "profiler.h"
+#include "query_filter.h"
+#include "tag_pool.h"
 #include "utility.h"
+#include "utility/asserts.h"
+#include "world.h"
 
 #include <atomic>
 #include <cstddef>
 #include <functional>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace ECS {
 	template <class H, class... T>
 	struct System_iterator;
 	struct Entity_handle;
+	struct Command_buffer;
+	template <class... Components>
+	struct Group_view;
+	struct Ordered_index;
+	struct Index_result;
+	template <auto field, class Kind>
+	struct Index;
 	/*
 	System keeps the components of all Entitys in a vector per component type and allows to iterate over Entitys with specified components.
 	You only use System to iterate. Use Entities to add components.
+	All functions work on the components and systems of the current World of the calling thread, see world.h.
 	Limitations:
 		Cannot have multiple components of the same type in one Entity. You can get around that with an array or vector of components.
 	*/
@@ -28,54 +45,226 @@ namespace ECS {
 		};
 
 		template <class Component>
-		static std::vector<Utility::remove_cvr<Component>> &get_components() {
-			return components<Utility::remove_cvr<Component>>;
+		static typename Impl::Pool<Utility::remove_cvr<Component>>::Component_vector &get_components() {
+			return get_pool<Component>().components;
 		}
 		template <class Component>
 		static std::vector<Impl::Id_t> &get_ids() {
-			return ids<Utility::remove_cvr<Component>>;
+			return get_pool<Component>().ids;
 		}
+		template <class Component>
+		static Impl::Pool<Utility::remove_cvr<Component>> &get_pool() {
+			return World::current().get_pool<Utility::remove_cvr<Component>>();
+		}
+		//make room for capacity components of a type, adding components does not allocate until the pool is bigger
+		template <class Component>
+		static void reserve(std::size_t capacity) {
+			get_pool<Component>().reserve(capacity);
+		}
+		//free the memory that is not used by the current components of a type
+		template <class Component>
+		static void shrink() {
+			get_pool<Component>().shrink();
+		}
+		//allocate the components of a type with the given allocator of the type set in its Storage_policy, see pool.h. No component of the type may exist
+		//and the memory the allocator uses must outlive the World that owns the pool.
+		template <class Component>
+		static void set_allocator(const typename Impl::Pool<Utility::remove_cvr<Component>>::Allocator &allocator) {
+			get_pool<Component>().set_allocator(allocator);
+		}
+		//one field of all components with Column_storage in id order, for example get_column<&HP::hp>()
+		template <auto field>
+		static auto get_column() {
+			return get_pool<typename Utility::Member_pointer_traits<decltype(field)>::Class>().template column<field>();
+		}
+		//call f(fields &...) for every component with Column_storage, for_each_column<&Position::x, &Position::y>(f). All fields must belong to the same
+		//component. The loop only touches the given columns and is written so the compiler can vectorize it.
+		template <auto... fields, class Function>
+		static void for_each_column(Function &&f);
 		//get a range iterator for a list of components, range<Position, Direction> iterates over all Entities with both a Position and a Direction component
 		template <class... Components>
 		static System_iterator<Components...> range();
+		//filters in the list of components, such as Changed<Position>, only let through changes at or after since, see query_filter.h
+		template <class... Components>
+		static System_iterator<Components...> range(Changes::Tick_t since);
 		template <class... Components>
 		static Range<Components...> get_range();
+		//keep the entities that have all of the components packed at the front of their pools, see group.h
+		template <class... Components>
+		static void add_group();
+		//iterate over a group that was declared with add_group
+		template <class... Components>
+		static Group_view<Utility::remove_cvr<Components>...> get_group();
+		//declare a secondary index on a field of a component, for example add_index<&HP::hp>() or add_index<&Name::id, Hash_index>(), see index.h.
+		//Declare indexes before systems that use them run in parallel.
+		template <auto field, class Kind = Ordered_index>
+		static void add_index();
+		//get an index that was declared with add_index
+		template <auto field, class Kind = Ordered_index>
+		static Index<field, Kind> &get_index();
+		//iterate over the entities found by an index lookup that have all of the components, in id order. entities must outlive the iterator.
+		template <class... Components>
+		static System_iterator<Components...> range(const Index_result &entities);
+		template <class... Components>
+		static System_iterator<Components...> range(const Index_result &&entities) = delete;
 		//get entity handle from a component that has been added to an entity
 		template <class Component>
 		static Entity_handle component_to_entity_handle(const Component &component);
-		//run all systems
-		static void run_systems() {
-			for (auto &f : function_pointer_systems) {
-				f();
-			}
-			for (auto &f : function_systems) {
-				f();
-			}
-		}
-		//add a system
+		//look up the components of count entities at once, result[i] is the component of entities[i] or nullptr if it has none.
+		//Loads for later entities are started early, so for large batches the cache misses overlap instead of adding up.
+		template <class Component>
+		static void lookup(const Entity_handle *entities, std::size_t count, Component **result);
+		//observers get the entities of one batch of events
+		using Observer = std::function<void(const std::vector<Entity_handle> &)>;
+		//call f with the entities that got a component of the type, in id order. Pools only queue their adds and removes, notify_observers delivers them in
+		//batches, so reacting costs per event instead of per entity per frame. Components that existed before the first observer of the type was added are
+		//not reported. An entity that lost the component and got it again before the notification is reported to on_remove and on_add observers.
+		template <class Component>
+		static void on_add(Observer f);
+		//call f with the entities that lost a component of the type, also by being destroyed. Handles of destroyed entities are only good for comparing.
+		template <class Component>
+		static void on_remove(Observer f);
+		//deliver the queued events, first the removals, then the adds of each type. run_systems calls it after flushing the command buffers and ending the
+		//expiry frame. Observers may change any component, so it must not be called from systems, only from the thread that calls run_systems between
+		//frames. Events caused by observers are delivered by the next call.
+		static void notify_observers();
+		//run all systems, then flush the command buffers, end the frame of the expiry subsystem (see expiry.h), notify the observers (see on_add) and advance
+		//the change tick (see change_log.h)
+		//Systems that don't access the same components run at the same time on worker threads. If one system writes a component another system
+		//accesses, the one that was added first runs first. Systems must only access the components they were added with.
+		static void run_systems();
+		//set the number of worker threads run_systems uses in addition to the calling thread. 0 runs all systems in order on the calling thread.
+		//The default is one less than the number of hardware threads. Every World has its own workers.
+		static void set_worker_count(std::size_t count);
+		//changes recorded here are applied at the end of run_systems. Every thread gets its own command buffer, so systems running at the same time
+		//can record changes without locking.
+		static Command_buffer &get_command_buffer();
+		//the systems, schedule, workers and command buffers of a World, defined in system.cpp
+		struct State;
+		//name of a system in the profiler, pass it as the first argument to any add_*system function: add_system<Speed>(System::Name{"move"}, f)
+		struct Name {
+			const char *name;
+		};
+		//add a system. It only reads components given as const, for example add_system<const Speed, Position> reads Speed and writes Position.
+		//Components can be wrapped in Not, Optional and change filters, see query_filter.h. Not only reads.
+		//Filters such as Changed<Speed> compare against the start of the previous run of the system, see query_filter.h.
 		template <class... Components, class Function>
 		static void add_system(Function &&f) {
-			add_to_system([f = std::move(f)] {
-				for (auto sit = range<Components...>(); sit; sit.advance()) {
-					f(sit.get_entity_handle());
-				}
-			});
+			add_to_system(
+				[ f = std::move(f), last_run = Changes::Tick_t{0} ]() mutable {
+					const auto since = start_run<Components...>(last_run);
+					Profiler::Impl::Visit_counter visited;
+					for (auto sit = range<Components...>(since); sit; sit.advance()) {
+						f(sit.get_entity_handle());
+						visited.add();
+					}
+					return visited.get();
+				},
+				get_accesses<Components...>(), false);
 		}
 		//add a system which computes something once for all entities
 		template <class... Components, class Function, class PrecomputeFunction>
 		static void add_system(Function &&f, PrecomputeFunction &&pf) {
-			add_to_system([ f = std::move(f), pf = std::move(pf) ] {
-				auto pc = pf();
-				for (auto sit = range<Components...>(); sit; sit.advance()) {
-					f(sit.get_entity_handle(), pc);
-				}
-			});
+			add_to_system(
+				[ f = std::move(f), pf = std::move(pf), last_run = Changes::Tick_t{0} ]() mutable {
+					const auto since = start_run<Components...>(last_run);
+					auto pc = pf();
+					Profiler::Impl::Visit_counter visited;
+					for (auto sit = range<Components...>(since); sit; sit.advance()) {
+						f(sit.get_entity_handle(), pc);
+						visited.add();
+					}
+					return visited.get();
+				},
+				get_accesses<Components...>(), false);
 		}
 
-		//add a system which doesn't loop through components
+		//add a system whose entities are split into chunks of grain_size entities of the smallest pool that run in parallel on the worker threads.
+		//The chunk boundaries don't depend on the number of threads. f must only change the components of the entity it is given.
+		template <class... Components, class Function>
+		static void add_parallel_system(std::size_t grain_size, Function &&f) {
+			add_to_system(
+				[ f = std::move(f), grain_size, last_run = Changes::Tick_t{0} ]() mutable {
+					const auto since = start_run<Components...>(last_run);
+					return run_chunked<Components...>(grain_size, since, [&f](System_iterator<Components...> &sit, Profiler::Impl::Visit_counter &visited) {
+						for (; sit; sit.advance()) {
+							f(sit.get_entity_handle());
+							visited.add();
+						}
+					});
+				},
+				get_accesses<Components...>(), false);
+		}
+		//parallel system which computes something once for all entities, all chunks get the same result of pf
+		template <class... Components, class Function, class PrecomputeFunction>
+		static void add_parallel_system(std::size_t grain_size, Function &&f, PrecomputeFunction &&pf) {
+			add_to_system(
+				[ f = std::move(f), pf = std::move(pf), grain_size, last_run = Changes::Tick_t{0} ]() mutable {
+					const auto since = start_run<Components...>(last_run);
+					const auto pc = pf();
+					return run_chunked<Components...>(grain_size, since, [&f, &pc](System_iterator<Components...> &sit, Profiler::Impl::Visit_counter &visited) {
+						for (; sit; sit.advance()) {
+							f(sit.get_entity_handle(), pc);
+							visited.add();
+						}
+					});
+				},
+				get_accesses<Components...>(), false);
+		}
+		//parallel system with a reduction: every chunk gets its own copy of the result of pf which f may change. After all chunks are done the copies are
+		//passed to reduce in chunk order, so the result does not depend on how the chunks were scheduled.
+		template <class... Components, class Function, class PrecomputeFunction, class Reduce>
+		static void add_parallel_system(std::size_t grain_size, Function &&f, PrecomputeFunction &&pf, Reduce &&reduce) {
+			add_to_system(
+				[ f = std::move(f), pf = std::move(pf), reduce = std::move(reduce), grain_size, last_run = Changes::Tick_t{0} ]() mutable {
+					const auto since = start_run<Components...>(last_run);
+					const auto pc = pf();
+					std::vector<Utility::remove_cvr<decltype(pc)>> chunk_results;
+					const auto visited = run_chunked<Components...>(
+						grain_size, since, chunk_results, pc,
+						[&f](System_iterator<Components...> &sit, auto &chunk_result, Profiler::Impl::Visit_counter &chunk_visited) {
+							for (; sit; sit.advance()) {
+								f(sit.get_entity_handle(), chunk_result);
+								chunk_visited.add();
+							}
+						});
+					for (auto &chunk_result : chunk_results) {
+						reduce(std::move(chunk_result));
+					}
+					return visited;
+				},
+				get_accesses<Components...>(), false);
+		}
+		//add a system which doesn't loop through components. It may access anything, so it never runs at the same time as other systems.
 		template <class Function>
 		static void add_independent_system(Function &&f) {
-			add_to_system(std::forward<Function>(f));
+			add_to_system(
+				[f = std::forward<Function>(f)]() mutable {
+					f();
+					return std::size_t{0};
+				},
+				{}, true);
+		}
+		//named versions of the add_*system functions
+		template <class... Components, class Function>
+		static void add_system(Name name, Function &&f) {
+			add_system<Components...>(std::forward<Function>(f));
+			get_systems().back().name = name.name;
+		}
+		template <class... Components, class Function, class PrecomputeFunction>
+		static void add_system(Name name, Function &&f, PrecomputeFunction &&pf) {
+			add_system<Components...>(std::forward<Function>(f), std::forward<PrecomputeFunction>(pf));
+			get_systems().back().name = name.name;
+		}
+		template <class... Components, class... Functions>
+		static void add_parallel_system(Name name, std::size_t grain_size, Functions &&... functions) {
+			add_parallel_system<Components...>(grain_size, std::forward<Functions>(functions)...);
+			get_systems().back().name = name.name;
+		}
+		template <class Function>
+		static void add_independent_system(Name name, Function &&f) {
+			add_independent_system(std::forward<Function>(f));
+			get_systems().back().name = name.name;
 		}
 
 		private:
@@ -87,33 +276,94 @@ namespace ECS {
 		friend struct ECS::System_iterator;
 #endif
 
-		//vector to store the components
-		template <class Component>
-		static std::vector<Component> components;
-		//vector to store the IDs. ids and components are locked, so components<CTYPE>[x] is the component that belongs to entity ids<CTYPE>[x]
-		template <class Component>
-		static std::vector<Impl::Id_t> ids;
 		/* TODO: could make components and ids use the same memory since they reallocate at the same time, but this only saves a few memory allocations
 		   and is probably not worth it */
-		template <class Function>
-		static void add_to_system(Function &&f) {
-			if constexpr (std::is_convertible<Function, void (*)()>::value) {
-				function_pointer_systems.push_back(std::forward<Function>(f));
+		//which components a system reads and writes
+		struct Access {
+			const void *type;
+			bool write;
+		};
+		struct Registered_system {
+			//runs the system and returns the number of entities it visited if the profiler is enabled
+			std::function<std::size_t()> function;
+			std::vector<Access> accesses;
+			//exclusive systems conflict with all other systems
+			bool exclusive;
+			const char *name = nullptr;
+		};
+		template <class... Components>
+		static std::vector<Access> get_accesses() {
+			//tags have no data, systems only read whether entities have them
+			return {Access{Impl::type_key<typename Impl::Query_term<Components>::Component>(),
+						   !std::is_const<typename Impl::Query_term<Components>::Access>::value &&
+							   !Impl::is_tag_storage<typename Impl::Query_term<Components>::Component>}...};
+		}
+		static void run_system(std::size_t index);
+		//the tick the filters of a system compare against. Systems with filters start a new tick on every run, so the changes made before the run are
+		//not seen again in the next run.
+		template <class... Components>
+		static Changes::Tick_t start_run(Changes::Tick_t &last_run) {
+			if constexpr (Impl::has_change_filter<Components...>) {
+				return std::exchange(last_run, Changes::advance_tick());
 			} else {
-				function_systems.push_back(std::forward<Function>(f));
+				return 0;
 			}
 		}
-		static std::vector<void (*)()> function_pointer_systems;
-		static std::vector<std::function<void()>> function_systems;
+		//call run_chunk(chunk_index) for chunk_index in [0, chunk_count) on the worker threads and wait until all are done
+		static void run_in_parallel(std::size_t chunk_count, const std::function<void(std::size_t)> &run_chunk);
+		//returns the number of entities visited by all chunks
+		template <class... Components, class Function>
+		static std::size_t run_chunked(std::size_t grain_size, Changes::Tick_t since, Function &&f) {
+			assert_fast(grain_size > 0);
+			const System_iterator<Components...> prototype(since);
+			const auto chunk_count = (prototype.get_driver_size() + grain_size - 1) / grain_size;
+			std::atomic<std::size_t> visited{0};
+			run_in_parallel(chunk_count, [&](std::size_t chunk) {
+				auto sit = prototype;
+				sit.restrict_to(chunk * grain_size, (chunk + 1) * grain_size);
+				Profiler::Impl::Visit_counter chunk_visited;
+				f(sit, chunk_visited);
+				if (Profiler::enabled) {
+					visited += chunk_visited.get();
+				}
+			});
+			return visited;
+		}
+		template <class... Components, class Result, class Function>
+		static std::size_t run_chunked(std::size_t grain_size, Changes::Tick_t since, std::vector<Result> &chunk_results, const Result &initial,
+									   Function &&f) {
+			assert_fast(grain_size > 0);
+			const System_iterator<Components...> prototype(since);
+			const auto chunk_count = (prototype.get_driver_size() + grain_size - 1) / grain_size;
+			chunk_results.assign(chunk_count, initial);
+			std::atomic<std::size_t> visited{0};
+			run_in_parallel(chunk_count, [&](std::size_t chunk) {
+				auto sit = prototype;
+				sit.restrict_to(chunk * grain_size, (chunk + 1) * grain_size);
+				Profiler::Impl::Visit_counter chunk_visited;
+				f(sit, chunk_results[chunk], chunk_visited);
+				if (Profiler::enabled) {
+					visited += chunk_visited.get();
+				}
+			});
+			return visited;
+		}
+		template <class Function>
+		static void add_to_system(Function &&f, std::vector<Access> accesses, bool exclusive) {
+			get_systems().push_back({std::forward<Function>(f), std::move(accesses), exclusive});
+		}
+		//the systems of the current world
+		static std::vector<Registered_system> &get_systems();
+		//moves the events that were queued by the pool of a component type to added and removed
+		using Collect_function = void (*)(std::vector<Entity_handle> &added, std::vector<Entity_handle> &removed);
+		template <class Component>
+		static void collect_events(std::vector<Entity_handle> &added, std::vector<Entity_handle> &removed);
+		static void add_observer(const void *type, Collect_function collect, Observer f, bool on_add);
 	};
 #ifndef NDEBUG
 	template <class T>
 	static std::atomic<unsigned> component_state;
 #endif
-	template <class Component>
-	std::vector<Component> ECS::System::components{};
-	template <class Component>
-	std::vector<ECS::Impl::Id_t> ECS::System::ids{ECS::Impl::max_id};
 } // namespace ECS
 
 #endif // SYSTEM_BASE_H
@@ -1,105 +1,360 @@
 #ifndef SYSTEMITERATOR_H
 #define SYSTEMITERATOR_H
 
+#include "change_log.h"
 #include "entity_handle.h"
+#include "query_filter.h"
 #include "system_base.h"
 #include "utility/asserts.h"
 
-#include <iostream>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <tuple>
+#include <utility>
 
 namespace ECS {
 	/*
 	Iterator over Entitys with specifiable components.
-	Iterating over Entitys with some specific components goes through all entities with any of the components
+	The smallest pool drives the iteration, the other sorted pools skip ahead with galloping search and sparse set pools are looked up, so iterating
+	costs about O(smallest * log(largest / smallest)) instead of touching every entity that has any of the components.
+	If the smallest pool is a sparse set, entities are visited in its dense order instead of in id order.
+	Components can be wrapped in filters such as Changed<HP>, Not<HP> and Optional<HP>, see query_filter.h. Change filters are checked before the other
+	pools are searched. Only required components can drive the iteration. The ids of an index lookup can drive it too, see index.h.
 	TODO: It would be more ideomatic but less efficient to use begin and end style iterators.
 	TODO: It would make sense to have a get function that returns a tuple of components. For that the struct layout (?) needs to be changed.
 	TODO: Add casting/converting iterators. Removing a component would be fairly easy, adding a component would initiate searching.
 		  Unrelated iterators don't really make sense.
-	TODO: Replace .at with []
 	*/
 	template <class First, class... Rest>
 	struct System_iterator {
+		//starts at the first Entity that has all components
+		System_iterator()
+			: System_iterator(0) {}
+		//filters such as Changed<HP> only let through changes at or after since
+		explicit System_iterator(Changes::Tick_t since)
+			: since(since) {
+			static_assert(Impl::Query_term<First>::presence == Impl::Presence::required ||
+							  ((Impl::Query_term<Rest>::presence == Impl::Presence::required) || ...),
+						  "At least one component must be required");
+			//the smallest pool drives the join, so the cost scales with the smallest pool instead of the largest
+			std::size_t smallest_size = -1;
+			for_each_index([&](auto index) {
+				using Component = typename typelist::template nth<index>;
+				if constexpr (Term<index>::presence == Impl::Presence::required) {
+					const auto size = pool<index>().size();
+					if (size < smallest_size || (size == smallest_size && !Impl::is_sparse_set<Component>)) {
+						smallest_size = size;
+						driver = index;
+						driver_ids = &pool<index>().ids;
+						sorted_driver = !Impl::is_sparse_set<Component>;
+					}
+				}
+			});
+			if (sorted_driver) {
+				advance(0);
+			} else {
+				find_match_from_slot();
+			}
+		}
+		//only visits the entities in ids, which must be sorted and end with max_id, such as the result of an index lookup. The pools of all components
+		//are searched from the ids, so the cost grows with the number of ids and not with the size of the pools.
+		System_iterator(const std::vector<Impl::Id_t> &ids, Changes::Tick_t since)
+			: since(since) {
+			driver = typelist::size;
+			driver_ids = &ids;
+			advance(0);
+		}
 		void advance() {
-			assert_fast(System::get_ids<First>().at(current_indexes[0]) != Impl::max_id);
-			if constexpr (sizeof...(Rest) == 0) {
-				current_indexes[0]++;
+			assert_fast(current_id != Impl::max_id);
+			if (sorted_driver) {
+				advance(current_id + 1);
 			} else {
-				advance(System::get_ids<First>().at(current_indexes[0]) + 1);
+				current_indexes[driver]++;
+				find_match_from_slot();
 			}
 		}
+		//advance to the first Entity with all components whose id is at least target. Only possible if iteration is ordered by id, which is the case if
+		//the smallest pool is sorted.
 		void advance(Impl::Id_t target) {
-			if constexpr (sizeof...(Rest) == 0) {
-				get_advanced_index(target);
-			} else {
-				auto new_target = get_advanced_index(target);
-				while (new_target != target && new_target != Impl::max_id) {
-					target = new_target;
-					new_target = get_advanced_index(target);
+			assert_fast(sorted_driver);
+			for (;;) {
+				current_id = seek_driver(target);
+				if (current_id == Impl::max_id) {
+					return;
 				}
+				const auto next_target = match<0>(current_id);
+				if (next_target == current_id) {
+					return;
+				}
+				target = next_target;
 			}
 		}
+		//not available with Not terms
 		decltype(auto) operator*() const {
 			if constexpr (sizeof...(Rest) == 0) { //single component, just return a reference
 				return get<First>();
 			} else { //multiple components, return a tuple of references to the components
-				return std::tie(get<First>(), get<Rest>()...);
+				return std::tuple<decltype(get<First>()), decltype(get<Rest>())...>{get<First>(), get<Rest>()...};
 			}
 		}
 
 		operator bool() const {
-			return System::get_ids<First>().at(current_indexes[0]) != Impl::max_id;
+			return current_id != Impl::max_id;
 		}
 		auto &operator++() {
 			advance();
 			return *this;
 		}
+		//components that were given as const can only be read
+		//components with Column_storage are returned as Column_reference
+		//Optional components are returned as pointers that are nullptr or as Column_reference that converts to false if the entity has none
+		//Only Optional tags can be gotten, as a pointer to the instance the entities with the tag share
+		template <class U>
+		decltype(auto) get() const {
+			constexpr auto index = typelist::template get_index<typename Impl::Query_term<U>::Component>();
+			using Component = typename typelist::template nth<index>;
+			static_assert(Term<index>::presence != Impl::Presence::excluded, "Components given as Not don't exist");
+			static_assert(!Impl::is_tag_filter<typename Utility::Type_list<First, Rest...>::template nth<index>>, "Tags have no data, they only filter");
+			if constexpr (Impl::is_tag_storage<Component>) {
+				return pool<index>().contains(current_id) ? &pool<index>().instance : nullptr;
+			} else if constexpr (Term<index>::presence == Impl::Presence::optional) {
+				const bool present = has_optional<index>();
+				if constexpr (Impl::is_column_storage<Component>) {
+					return Column_reference<Component>{present ? &pool<index>() : nullptr, current_indexes[index]};
+				} else {
+					return present ? &get_component<index>() : nullptr;
+				}
+			} else if constexpr (Impl::is_column_storage<Component>) {
+				return Column_reference<Component>{&pool<index>(), current_indexes[index]};
+			} else {
+				return get_component<index>();
+			}
+		}
+		//same as get, but the component is recorded as changed if its Storage_policy sets track_changes, see change_log.h
 		template <class U>
-		auto &get() const {
-			using typelist = Utility::Type_list<First, Rest...>;
-			constexpr auto index = typelist::template get_index<U>();
-			Log::log_debug() << System::get_components<U>().size();
-			Log::log_debug() << Utility::type_name<U>();
-			return System::get_components<U>().at(current_indexes[index]);
+		decltype(auto) modify() const {
+			static_assert(!std::is_const<std::remove_reference_t<decltype(get<U>())>>::value, "Components given as const cannot be modified");
+			using Component = typename Impl::Query_term<U>::Component;
+			if constexpr (Impl::tracks_changes<Component>) {
+				pool<typelist::template get_index<Component>()>().changes.changed(current_id);
+			}
+			return get<U>();
 		}
+		//the id of the current entity in the pool of every component, max_id for Not components and Optional components the entity doesn't have
 		auto get_ids() const {
-			std::array<std::size_t, sizeof...(Rest) + 1> ids;
+			std::array<Impl::Id_t, sizeof...(Rest) + 1> ids;
 			get_ids(ids);
 			return ids;
 		}
 		ECS::Entity_handle get_entity_handle() const {
-			return Entity_handle{current_indexes[0]};
+			return Entity_handle{current_id};
+		}
+		//number of positions in the pool that drives the iteration
+		std::size_t get_driver_size() const {
+			return driver_ids->size() - 1;
+		}
+		//only visit the entities at the positions [begin_position, end_position) of the driving pool. Splits the iteration into independent chunks.
+		void restrict_to(std::size_t begin_position, std::size_t end_position) {
+			begin_position = std::min(begin_position, get_driver_size());
+			driver_end = end_position;
+			current_indexes[driver] = begin_position;
+			if (sorted_driver) {
+				//the other sorted pools start at the first id of the chunk
+				const auto first_id = (*driver_ids)[begin_position];
+				for_each_index([&](auto index) {
+					using Component = typename typelist::template nth<index>;
+					if constexpr (!Impl::is_sparse_set<Component>) {
+						if (index != driver) {
+							const auto &ids = pool<index>().ids;
+							current_indexes[index] = std::lower_bound(begin(ids), end(ids), first_id) - begin(ids);
+						}
+					}
+				});
+				advance(first_id);
+			} else {
+				find_match_from_slot();
+			}
 		}
 
 		private:
-		template <int index = 0>
-		auto get_advanced_index(Impl::Id_t target) {
-			using typelist = Utility::Type_list<First, Rest...>;
-			using index_type = typename typelist::template nth<index>;
-			auto &ids = System::get_ids<index_type>();
-			{
-				auto logger = Log::log_debug();
-				logger << ids.size() << '\n';
-				for (const auto &id : ids) {
-					logger << id << ' ';
+		using typelist = Utility::Type_list<typename Impl::Query_term<First>::Component, typename Impl::Query_term<Rest>::Component...>;
+		template <std::size_t index>
+		using Term = Impl::Query_term<typename Utility::Type_list<First, Rest...>::template nth<index>>;
+		template <std::size_t index>
+		decltype(auto) get_component() const {
+			auto &component = pool<index>().components[current_indexes[index]];
+			if constexpr (std::is_const<typename Term<index>::Access>::value) {
+				return std::as_const(component);
+			} else {
+				return component;
+			}
+		}
+		template <class Function, std::size_t... indexes>
+		static void for_each_index(Function &&f, std::index_sequence<indexes...>) {
+			(f(std::integral_constant<std::size_t, indexes>{}), ...);
+		}
+		template <class Function>
+		static void for_each_index(Function &&f) {
+			for_each_index(std::forward<Function>(f), std::make_index_sequence<typelist::size>{});
+		}
+
+		//move the cursor of the sorted driver to the first id that is at least target and return that id
+		Impl::Id_t seek_driver(Impl::Id_t target) {
+			const auto &ids = *driver_ids;
+			auto &cursor = current_indexes[driver];
+			cursor = Impl::gallop(ids, cursor, target);
+			return cursor < driver_end ? ids[cursor] : Impl::max_id;
+		}
+		//find the components of id in all pools other than the driver. Returns id if all components exist, otherwise a larger id to continue from.
+		//Not components must be missing and Optional components may be missing, their position is npos or the position of a different id then
+		template <std::size_t index>
+		Impl::Id_t match(Impl::Id_t id) {
+			if constexpr (index == 0 && Impl::has_tag_filter<First, Rest...>) {
+				const auto next = match_tags(id);
+				if (next != id) {
+					return next;
 				}
 			}
-			while (ids.at(current_indexes[index]) < target) {
-				current_indexes[index]++;
+			if constexpr (index == 0 && Impl::has_change_filter<First, Rest...>) {
+				const auto next = match_filters(id);
+				if (next != id) {
+					return next;
+				}
 			}
-			if constexpr (index + 1 < typelist::size) {
-				return std::max(current_indexes[index], get_advanced_index<index + 1>(current_indexes[index]));
+			if constexpr (index == typelist::size) {
+				return id;
+			} else {
+				using Component = typename typelist::template nth<index>;
+				constexpr auto presence = Term<index>::presence;
+				if (!Impl::is_tag_storage<Component> && index != driver) { //tags are checked by match_tags
+					if (Impl::is_sparse_set<Component> || !sorted_driver) { //look up the id directly
+						const auto slot = pool<index>().find(id);
+						if (presence == Impl::Presence::required && slot == Impl::Pool<Component>::npos) {
+							return id + 1;
+						}
+						if (presence == Impl::Presence::excluded && slot != Impl::Pool<Component>::npos) {
+							return id + 1;
+						}
+						current_indexes[index] = slot;
+					} else { //ids only grow, skip ahead from the last position
+						const auto &ids = pool<index>().ids;
+						auto &cursor = current_indexes[index];
+						cursor = Impl::gallop(ids, cursor, id);
+						if (presence == Impl::Presence::required && ids[cursor] != id) {
+							return ids[cursor];
+						}
+						if (presence == Impl::Presence::excluded && ids[cursor] == id) {
+							return id + 1;
+						}
+					}
+				}
+				return match<index + 1>(id);
+			}
+		}
+		template <std::size_t index>
+		bool has_optional() const {
+			const auto position = current_indexes[index];
+			return position != Impl::Pool<typename typelist::template nth<index>>::npos &&
+				   pool<index>().ids[position] == current_id;
+		}
+		//returns id if the entity has all required tags and none of the excluded tags, otherwise the first id of the next index that does or max_id.
+		//The bitmaps of the tags are combined a word at a time, so indexes without the tags are skipped 64 at a time.
+		Impl::Id_t match_tags(Impl::Id_t id) const {
+			using Word = std::uint64_t;
+			constexpr std::size_t word_bits = 64;
+			const std::size_t first_index = Impl::id_index(id);
+			for (auto word_index = first_index / word_bits;; word_index++) {
+				auto word = ~Word{0};
+				//no index after this word has all required tags
+				bool last_word = false;
+				for_each_index([&](auto index) {
+					using Component = typename typelist::template nth<index>;
+					if constexpr (Impl::is_tag_storage<Component>) {
+						const auto &bitmap = pool<index>().bitmap;
+						const auto bits = word_index < bitmap.size() ? bitmap[word_index] : Word{0};
+						if constexpr (Term<index>::presence == Impl::Presence::required) {
+							if (index == driver) { //the driver only yields ids with its tag
+								return;
+							}
+							word &= bits;
+							last_word |= word_index + 1 >= bitmap.size();
+						} else if constexpr (Term<index>::presence == Impl::Presence::excluded) {
+							word &= ~bits;
+						}
+					}
+				});
+				if (word_index == first_index / word_bits) {
+					word &= ~Word{0} << (first_index % word_bits);
+				}
+				if (word != 0) {
+					const auto index = word_index * word_bits + __builtin_ctzll(word);
+					if (index == first_index) {
+						return id;
+					}
+					return index >= Impl::max_index ? Impl::max_id : Impl::make_id(static_cast<Impl::Index_t>(index), 0);
+				}
+				if (last_word) {
+					return Impl::max_id;
+				}
+			}
+		}
+		//returns id if the components of id pass all filters, otherwise a larger id to continue from
+		Impl::Id_t match_filters(Impl::Id_t id) const {
+			auto next = id;
+			for_each_index([&](auto index) {
+				if constexpr (Term<index>::change_filter != Impl::Change_filter::none) {
+					if (next == id) {
+						next = pool<index>().changes.next_change(
+							id, since, Term<index>::change_filter == Impl::Change_filter::added);
+					}
+				}
+			});
+			return next;
+		}
+		//the driver is a sparse set: walk its dense ids from the current slot until all other components exist
+		void find_match_from_slot() {
+			const auto &ids = *driver_ids;
+			for (auto &cursor = current_indexes[driver];; cursor++) {
+				current_id = cursor < driver_end ? ids[cursor] : Impl::max_id;
+				if (current_id == Impl::max_id || match<0>(current_id) == current_id) {
+					return;
+				}
 			}
-			return ids.at(current_indexes[index]);
 		}
 		template <std::size_t index = 0>
-		void get_ids(std::array<std::size_t, sizeof...(Rest) + 1> &ids) {
-			using typelist = Utility::Type_list<First, Rest...>;
-			ids[index] = System::get_ids<typelist::nth<index>>(current_indexes[index]);
-			if constexpr (index + 1 < ids.size()) {
+		void get_ids(std::array<Impl::Id_t, sizeof...(Rest) + 1> &ids) const {
+			using Component = typename typelist::template nth<index>;
+			constexpr auto presence = Term<index>::presence;
+			if constexpr (presence == Impl::Presence::excluded) {
+				ids[index] = Impl::max_id;
+			} else if constexpr (Impl::is_tag_storage<Component>) { //tags have no position, only a bit
+				ids[index] = presence == Impl::Presence::required || pool<index>().contains(current_id) ? current_id : Impl::max_id;
+			} else if constexpr (presence == Impl::Presence::optional) {
+				ids[index] = has_optional<index>() ? current_id : Impl::max_id;
+			} else {
+				ids[index] = pool<index>().ids[current_indexes[index]];
+			}
+			if constexpr (index + 1 < typelist::size) {
 				get_ids<index + 1>(ids);
 			}
 		}
-		std::array<std::size_t, sizeof...(Rest) + 1> current_indexes{};
+		//the pools of the world the iterator was created in
+		template <std::size_t index>
+		Impl::Pool<typename typelist::template nth<index>> &pool() const {
+			return *std::get<index>(pools);
+		}
+		std::tuple<Impl::Pool<typename Impl::Query_term<First>::Component> *, Impl::Pool<typename Impl::Query_term<Rest>::Component> *...> pools{
+			&System::get_pool<typename Impl::Query_term<First>::Component>(), &System::get_pool<typename Impl::Query_term<Rest>::Component>()...};
+		//the last position is the cursor in the ids of an index lookup
+		std::array<std::size_t, sizeof...(Rest) + 2> current_indexes{};
+		Impl::Id_t current_id = Impl::max_id;
+		//the component whose pool decides the iteration order, typelist::size if the ids of an index lookup do
+		std::size_t driver = 0;
+		const std::vector<Impl::Id_t> *driver_ids = nullptr;
+		std::size_t driver_end = -1;
+		bool sorted_driver = true;
+		Changes::Tick_t since = 0;
 	};
 
 	//comparison functions
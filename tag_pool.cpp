@@ -0,0 +1 @@
+#include "tag_pool.h"
\ No newline at end of file
@@ -0,0 +1,169 @@
+#ifndef TAG_POOL_H
+#define TAG_POOL_H
+
+#include "change_log.h"
+#include "ecs_impl.h"
+#include "pool.h"
+#include "utility/asserts.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+namespace ECS {
+	namespace Impl {
+		/*
+		Storage for empty components such as Common_components::Enemy, which is the default for all empty types.
+		There is no component vector, a tag is the id of its entity in a sorted vector and one bit per entity index in a dense bitmap.
+		Checking whether an entity has the tag is a bit test, iterations combine the bitmaps of all tags of a query a word at a time, see System_iterator.
+		Tags have no data, so getting a tag from an entity returns a pointer to a shared instance or nullptr, and iterators only filter by them.
+		*/
+		template <class Component>
+		struct Pool<Component, Tag_storage> {
+			static_assert(std::is_empty<Component>::value, "Only empty types can be stored as tags");
+			using Word = std::uint64_t;
+			static constexpr std::size_t npos = -1;
+			static constexpr bool sparse = false;
+			static constexpr std::size_t word_bits = 64;
+
+			//ids has an extra max_id at the end so iterators can stop without checking the size
+			std::vector<Id_t> ids{max_id};
+			//bit i of bitmap[i / word_bits] is set if the entity with index i has the tag. Can be shorter than the number of entities.
+			std::vector<Word> bitmap;
+			//only used if tracks_changes<Component>
+			Change_log changes;
+			//only used while the type has observers
+			Pool_events events;
+			//what an entity that has the tag gets from get
+			static inline const Component instance{};
+
+			std::size_t size() const {
+				return ids.size() - 1;
+			}
+			void reserve(std::size_t capacity) {
+				ids.reserve(capacity + 1);
+			}
+			void shrink() {
+				ids.shrink_to_fit();
+				bitmap.shrink_to_fit();
+			}
+			//true if the entity with the given id has the tag, O(1). Only tells entities apart by their index, so id must not belong to a destroyed entity.
+			bool contains(Id_t id) const {
+				const auto index = id_index(id);
+				return index / word_bits < bitmap.size() && (bitmap[index / word_bits] >> (index % word_bits) & 1);
+			}
+			//the position of the id, O(log n). Prefer contains.
+			std::size_t find(Id_t id) const {
+				if (!contains(id)) {
+					return npos;
+				}
+				const auto position = std::lower_bound(begin(ids), end(ids), id) - begin(ids);
+				return ids[position] == id ? position : npos;
+			}
+			template <class... Args>
+			void emplace(Id_t id, Args &&...) {
+				assert_fast(!contains(id)); //disallow multiple components of the same type for the same entity
+				ids.insert(std::lower_bound(begin(ids), end(ids), id), id);
+				set_bit(id);
+				record_added(id);
+			}
+			void erase(Id_t id) {
+				assert_fast(contains(id)); //make sure the component to remove exists
+				ids.erase(std::lower_bound(begin(ids), end(ids), id));
+				reset_bit(id);
+				record_removed(id);
+			}
+			//tag count entities with the given sorted ids, make is not called because tags have no data
+			template <class Make>
+			void append(const Id_t *new_ids, std::size_t count, Make &&) {
+				if (count == 0) {
+					return;
+				}
+				if (size() != 0 && ids[size() - 1] >= new_ids[0]) { //cannot append, merge
+					merge(new_ids, count);
+					return;
+				}
+				ids.pop_back();
+				ids.insert(end(ids), new_ids, new_ids + count);
+				ids.push_back(max_id);
+				for (std::size_t i = 0; i < count; i++) {
+					assert_fast(!contains(new_ids[i])); //disallow multiple components of the same type for the same entity
+					set_bit(new_ids[i]);
+					record_added(new_ids[i]);
+				}
+			}
+			void erase_sorted(const Id_t *erase_ids, std::size_t count) {
+				if (count == 0) {
+					return;
+				}
+				auto write = std::lower_bound(begin(ids), end(ids), erase_ids[0]);
+				std::size_t next_erase = 0;
+				for (auto read = write; *read != max_id; ++read) {
+					if (next_erase < count && *read == erase_ids[next_erase]) {
+						reset_bit(*read);
+						record_removed(*read);
+						next_erase++;
+						continue;
+					}
+					*write++ = *read;
+				}
+				assert_fast(next_erase == count); //make sure all components to remove existed
+				ids.erase(write, end(ids) - 1);
+			}
+			void insert_sorted(std::vector<std::pair<Id_t, Component>> &entries) {
+				std::vector<Id_t> new_ids;
+				new_ids.reserve(entries.size());
+				for (const auto &entry : entries) {
+					new_ids.push_back(entry.first);
+				}
+				merge(new_ids.data(), new_ids.size());
+			}
+
+			private:
+			void set_bit(Id_t id) {
+				const auto index = id_index(id);
+				if (index / word_bits >= bitmap.size()) {
+					bitmap.resize(index / word_bits + 1);
+				}
+				bitmap[index / word_bits] |= Word{1} << (index % word_bits);
+			}
+			void reset_bit(Id_t id) {
+				const auto index = id_index(id);
+				bitmap[index / word_bits] &= ~(Word{1} << (index % word_bits));
+			}
+			//add count sorted ids with one pass over the ids behind the first new one
+			void merge(const Id_t *new_ids, std::size_t count) {
+				if (count == 0) {
+					return;
+				}
+				const auto first = std::lower_bound(begin(ids), end(ids), new_ids[0]) - begin(ids);
+				const std::vector<Id_t> tail(begin(ids) + first, end(ids)); //includes the max_id at the end
+				ids.resize(first);
+				ids.reserve(first + tail.size() + count);
+				std::merge(begin(tail), end(tail), new_ids, new_ids + count, std::back_inserter(ids));
+				for (std::size_t i = 0; i < count; i++) {
+					assert_fast(!contains(new_ids[i])); //disallow multiple components of the same type for the same entity
+					set_bit(new_ids[i]);
+					record_added(new_ids[i]);
+				}
+			}
+			void record_added(Id_t id) {
+				events.added(id);
+				if constexpr (tracks_changes<Component>) {
+					changes.added(id);
+				}
+			}
+			void record_removed(Id_t id) {
+				events.removed(id);
+				if constexpr (tracks_changes<Component>) {
+					changes.removed(id);
+				}
+			}
+		};
+	} // namespace Impl
+} // namespace ECS
+
+#endif // TAG_POOL_H
@@ -0,0 +1,85 @@
+#include "command_buffer.h"
+#include "entity.h"
+#include "system.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+/*
+Changes recorded in a Command_buffer for entities that are destroyed before the buffer is flushed must be dropped.
+Exits with a non-zero status if a check fails.
+*/
+
+namespace {
+	struct Marker {
+		int value;
+	};
+	struct Payload {
+		int value;
+	};
+
+	int failures = 0;
+	void check(bool condition, const char *description) {
+		if (!condition) {
+			std::cerr << "failed: " << description << '\n';
+			failures++;
+		}
+	}
+
+	//the component of an entity destroyed before flush is not added and the reused index does not inherit it
+	void test_emplace_then_destroy() {
+		auto entities = ECS::Entity::create(3, Marker{0});
+		ECS::Command_buffer command_buffer;
+		const auto destroyed = entities[1].to_handle();
+		command_buffer.emplace<Payload>(destroyed, 5);
+		entities[1] = ECS::Entity{};
+		command_buffer.flush();
+		check(ECS::System::get_pool<Payload>().size() == 0, "no component is added for a destroyed entity");
+		std::size_t visited = 0;
+		for (auto sit = ECS::System::range<Payload>(); sit; sit.advance()) {
+			visited++;
+		}
+		check(visited == 0, "range does not visit destroyed entities");
+		auto reused = ECS::Entity::create(1, Marker{1});
+		check(!reused[0].get<Payload>(), "a new entity does not inherit the component");
+		check(reused[0].get<Marker>() && reused[0].get<Marker>()->value == 1, "a new entity gets its own components");
+	}
+
+	//an index that is reused before flush gets the components of neither the old nor the recorded change
+	void test_index_reused_before_flush() {
+		ECS::Entity entity;
+		entity.emplace<Marker>(Marker{0});
+		ECS::Command_buffer command_buffer;
+		command_buffer.emplace<Payload>(entity.to_handle(), 7);
+		entity = ECS::Entity{};
+		ECS::Entity reused;
+		command_buffer.flush();
+		check(!reused.get<Payload>(), "the entity that reuses the index does not get the component");
+		check(ECS::System::get_pool<Payload>().size() == 0, "the pool stays empty");
+	}
+
+	//removals for destroyed entities are dropped instead of erasing a component that no longer exists
+	void test_remove_then_destroy() {
+		ECS::Entity entity;
+		entity.emplace<Payload>(Payload{1});
+		ECS::Entity other;
+		other.emplace<Payload>(Payload{2});
+		ECS::Command_buffer command_buffer;
+		command_buffer.remove<Payload>(entity.to_handle());
+		entity = ECS::Entity{};
+		command_buffer.flush();
+		check(ECS::System::get_pool<Payload>().size() == 1, "only the component of the live entity is left");
+		check(other.get<Payload>() && other.get<Payload>()->value == 2, "the component of the live entity is untouched");
+	}
+} // namespace
+
+int main() {
+	test_emplace_then_destroy();
+	ECS::Entity::clear_all();
+	test_index_reused_before_flush();
+	ECS::Entity::clear_all();
+	test_remove_then_destroy();
+	ECS::Entity::clear_all();
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,84 @@
+#include "thread_pool.h"
+
+thread_local std::size_t ECS::Impl::Thread_pool::worker_index = 0;
+thread_local const ECS::Impl::Thread_pool *ECS::Impl::Thread_pool::current_pool = nullptr;
+
+ECS::Impl::Thread_pool::Thread_pool(std::size_t worker_count, std::function<void()> start_worker) {
+	queues.reserve(worker_count + 1);
+	for (std::size_t i = 0; i <= worker_count; i++) {
+		queues.push_back(std::make_unique<Queue>());
+	}
+	workers.reserve(worker_count);
+	for (std::size_t i = 1; i <= worker_count; i++) {
+		workers.emplace_back([this, i, start_worker] { work(i, start_worker); });
+	}
+}
+
+ECS::Impl::Thread_pool::~Thread_pool() {
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		stopping = true;
+	}
+	wake_up.notify_all();
+	for (auto &worker : workers) {
+		worker.join();
+	}
+}
+
+void ECS::Impl::Thread_pool::submit(std::function<void()> task) {
+	auto &queue = *queues[current_queue()];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back(std::move(task));
+	}
+	{
+		//taking the lock makes sure a worker that just found nothing to do is either already waiting or sees the new task
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		queued_tasks++;
+	}
+	wake_up.notify_one();
+}
+
+bool ECS::Impl::Thread_pool::run_one(std::size_t own_queue) {
+	std::function<void()> task;
+	{
+		auto &queue = *queues[own_queue];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty()) {
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+		}
+	}
+	for (std::size_t offset = 1; !task && offset < queues.size(); offset++) {
+		auto &queue = *queues[(own_queue + offset) % queues.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty()) {
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+		}
+	}
+	if (!task) {
+		return false;
+	}
+	queued_tasks--;
+	task();
+	return true;
+}
+
+void ECS::Impl::Thread_pool::work(std::size_t index, const std::function<void()> &start_worker) {
+	worker_index = index;
+	current_pool = this;
+	if (start_worker) {
+		start_worker();
+	}
+	for (;;) {
+		if (run_one(index)) {
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleep_mutex);
+		wake_up.wait(lock, [this] { return stopping || queued_tasks > 0; });
+		if (stopping) {
+			return;
+		}
+	}
+}
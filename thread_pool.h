@@ -0,0 +1,72 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ECS {
+	namespace Impl {
+		/*
+		Work stealing thread pool.
+		Every worker has its own queue. Tasks submitted by a worker go to the back of its own queue and are taken from the back again, so related work
+		stays on the same core. Idle workers steal from the front of other queues. Tasks submitted from other threads go to a shared queue.
+		The thread waiting for results helps running tasks instead of blocking.
+		*/
+		struct Thread_pool {
+			//a pool with 0 workers runs everything on the thread that calls help_until. start_worker is called on every worker thread before it runs tasks.
+			explicit Thread_pool(std::size_t worker_count, std::function<void()> start_worker = {});
+			Thread_pool(const Thread_pool &) = delete;
+			Thread_pool &operator=(const Thread_pool &) = delete;
+			~Thread_pool();
+
+			void submit(std::function<void()> task);
+			//run tasks on the calling thread until done returns true
+			template <class Predicate>
+			void help_until(Predicate &&done) {
+				while (!done()) {
+					if (!run_one(current_queue())) {
+						std::this_thread::yield();
+					}
+				}
+			}
+			std::size_t worker_count() const {
+				return workers.size();
+			}
+			//0 for threads that don't belong to a pool, 1 to worker_count for the workers
+			static std::size_t current_worker() {
+				return worker_index;
+			}
+
+			private:
+			struct Queue {
+				std::mutex mutex;
+				std::deque<std::function<void()>> tasks;
+			};
+			std::size_t current_queue() const {
+				return current_pool == this ? worker_index : 0;
+			}
+			//run a task from the given queue or stolen from another queue, returns false if there was nothing to do
+			bool run_one(std::size_t own_queue);
+			void work(std::size_t index, const std::function<void()> &start_worker);
+
+			//queues[0] is for threads outside the pool, queues[i] belongs to workers[i - 1]
+			std::vector<std::unique_ptr<Queue>> queues;
+			std::vector<std::thread> workers;
+			std::mutex sleep_mutex;
+			std::condition_variable wake_up;
+			std::atomic<std::size_t> queued_tasks{0};
+			bool stopping = false;
+			static thread_local std::size_t worker_index;
+			static thread_local const Thread_pool *current_pool;
+		};
+	} // namespace Impl
+} // namespace ECS
+
+#endif // THREAD_POOL_H
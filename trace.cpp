@@ -0,0 +1,123 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+namespace {
+	constexpr char magic[8] = {'E', 'C', 'S', 'T', 'R', 'A', 'C', 'E'};
+	constexpr std::uint32_t version = 1;
+
+	//event names and rings are registered rarely, the lock is never taken while recording
+	std::mutex registry_mutex;
+	std::vector<const char *> event_names;
+	//rings are shared with the thread that records into them so they can be dumped after the thread ended
+	std::vector<std::shared_ptr<Log::Trace::Ring>> rings;
+
+	Log::Trace::Ring &get_ring() {
+		thread_local const std::shared_ptr<Log::Trace::Ring> ring = [] {
+			auto new_ring = std::make_shared<Log::Trace::Ring>();
+			std::lock_guard<std::mutex> lock(registry_mutex);
+			new_ring->thread = static_cast<std::uint32_t>(rings.size());
+			rings.push_back(new_ring);
+			return new_ring;
+		}();
+		return *ring;
+	}
+
+	template <class T>
+	void write(std::ostream &output, const T &value) {
+		output.write(reinterpret_cast<const char *>(&value), sizeof value);
+	}
+	template <class T>
+	bool read(std::istream &input, T &value) {
+		return static_cast<bool>(input.read(reinterpret_cast<char *>(&value), sizeof value));
+	}
+} // namespace
+
+std::uint32_t Log::Trace::register_event(const char *name) {
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	event_names.push_back(name);
+	return static_cast<std::uint32_t>(event_names.size() - 1);
+}
+
+void Log::Trace::record(std::uint32_t event, Event_arguments arguments) {
+	auto &ring = get_ring();
+	const auto written = ring.written.load(std::memory_order_relaxed);
+	const auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	ring.events[written & (ring_capacity - 1)] = {static_cast<std::uint64_t>(time), event, ring.thread, arguments};
+	ring.written.store(written + 1, std::memory_order_release);
+}
+
+void Log::Trace::dump(std::ostream &output) {
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	output.write(magic, sizeof magic);
+	write(output, version);
+	write(output, static_cast<std::uint32_t>(event_names.size()));
+	for (auto name : event_names) {
+		const auto length = static_cast<std::uint32_t>(std::strlen(name));
+		write(output, length);
+		output.write(name, length);
+	}
+	write(output, static_cast<std::uint32_t>(rings.size()));
+	for (const auto &ring : rings) {
+		const auto written = ring->written.load(std::memory_order_acquire);
+		const auto count = std::min<std::uint64_t>(written, ring_capacity);
+		write(output, count);
+		for (auto i = written - count; i < written; i++) {
+			write(output, ring->events[i & (ring_capacity - 1)]);
+		}
+	}
+}
+
+bool Log::Trace::decode(std::istream &input, std::ostream &output) {
+	char file_magic[sizeof magic];
+	std::uint32_t file_version;
+	if (!input.read(file_magic, sizeof file_magic) || !std::equal(std::begin(magic), std::end(magic), file_magic) || !read(input, file_version) ||
+		file_version != version) {
+		return false;
+	}
+	std::uint32_t name_count;
+	if (!read(input, name_count)) {
+		return false;
+	}
+	std::vector<std::string> names(name_count);
+	for (auto &name : names) {
+		std::uint32_t length;
+		if (!read(input, length)) {
+			return false;
+		}
+		name.resize(length);
+		if (!input.read(&name[0], length)) {
+			return false;
+		}
+	}
+	std::uint32_t ring_count;
+	if (!read(input, ring_count)) {
+		return false;
+	}
+	std::vector<Event> events;
+	for (std::uint32_t ring = 0; ring < ring_count; ring++) {
+		std::uint64_t count;
+		if (!read(input, count)) {
+			return false;
+		}
+		for (std::uint64_t i = 0; i < count; i++) {
+			Event event;
+			if (!read(input, event)) {
+				return false;
+			}
+			events.push_back(event);
+		}
+	}
+	std::stable_sort(begin(events), end(events), [](const Event &lhs, const Event &rhs) { return lhs.time < rhs.time; });
+	for (const auto &event : events) {
+		output << event.time << ' ' << event.thread << ' ' << (event.event < names.size() ? names[event.event] : "?") << ' ' << event.arguments.arg0
+			   << ' ' << event.arguments.arg1 << '\n';
+	}
+	return true;
+}
@@ -0,0 +1,71 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <vector>
+
+/*
+Binary tracing that is cheap enough to leave on in production. Define ECS_TRACE to enable it, otherwise TRACE compiles to nothing.
+TRACE("name", arg0, arg1) records the time, the calling thread, the event and up to 2 integer arguments into a ring buffer of the calling thread.
+Recording is a few stores without locks or allocations. Only the first event of a thread and the first use of a TRACE statement take a lock.
+Every ring keeps the last ring_capacity events of its thread, older events are overwritten.
+Log::Trace::dump writes all rings in a compact binary format, Log::Trace::decode turns a dump into text offline.
+*/
+#ifdef ECS_TRACE
+#define TRACE(name, ...)                                                                   \
+	do {                                                                                   \
+		static const std::uint32_t trace_event = ::Log::Trace::register_event(name);       \
+		::Log::Trace::record(trace_event, ::Log::Trace::make_arguments(__VA_ARGS__));      \
+	} while (false)
+#else
+#define TRACE(name, ...) \
+	do {                 \
+	} while (false)
+#endif
+
+namespace Log {
+	namespace Trace {
+		struct Event_arguments {
+			std::uint64_t arg0;
+			std::uint64_t arg1;
+		};
+		template <class... Arguments>
+		Event_arguments make_arguments(Arguments... arguments) {
+			static_assert(sizeof...(Arguments) <= 2, "Trace events have at most 2 arguments");
+			std::uint64_t values[] = {static_cast<std::uint64_t>(arguments)..., 0, 0};
+			return {values[0], values[1]};
+		}
+		struct Event {
+			//nanoseconds of std::chrono::steady_clock
+			std::uint64_t time;
+			std::uint32_t event;
+			std::uint32_t thread;
+			Event_arguments arguments;
+		};
+		//number of events each thread keeps, must be a power of 2
+		constexpr std::size_t ring_capacity = std::size_t{1} << 14;
+
+		//single producer ring buffer, only the owning thread writes
+		struct Ring {
+			std::uint32_t thread;
+			//number of events ever recorded, the next event goes to events[written % ring_capacity]
+			std::atomic<std::uint64_t> written{0};
+			std::unique_ptr<Event[]> events{new Event[ring_capacity]};
+		};
+
+		//get the id of an event name, name must stay valid until the program ends
+		std::uint32_t register_event(const char *name);
+		void record(std::uint32_t event, Event_arguments arguments);
+		//write the events of all threads to output. Events recorded while dumping may be overwritten or only partially written.
+		void dump(std::ostream &output);
+		//convert the output of dump to one line per event ordered by time: time in ns, thread, event name, arguments
+		//returns false if input is not a trace
+		bool decode(std::istream &input, std::ostream &output);
+	} // namespace Trace
+} // namespace Log
+
+#endif // TRACE_H
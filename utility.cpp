@@ -1 +1,42 @@
-#include "utility.h"
\ No newline at end of file
+#include "utility.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace {
+	constexpr std::size_t page_size = 4096;
+	constexpr std::size_t huge_page_size = std::size_t{2} << 20;
+
+	std::size_t round_up(std::size_t bytes, std::size_t multiple) {
+		return (bytes + multiple - 1) / multiple * multiple;
+	}
+	//allocations of at least one huge page are rounded to huge pages so the end of the mapping can be backed by one too
+	std::size_t mapping_size(std::size_t bytes) {
+		return bytes < huge_page_size ? round_up(bytes, page_size) : round_up(bytes, huge_page_size);
+	}
+} // namespace
+
+void *Utility::allocate_huge_pages(std::size_t bytes) {
+#ifdef __linux__
+	const auto size = mapping_size(bytes);
+	void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED) {
+		throw std::bad_alloc{};
+	}
+	if (size >= huge_page_size) {
+		madvise(memory, size, MADV_HUGEPAGE); //only a hint, transparent huge pages may be disabled
+	}
+	return memory;
+#else
+	return ::operator new(mapping_size(bytes), std::align_val_t{page_size});
+#endif
+}
+
+void Utility::deallocate_huge_pages(void *memory, std::size_t bytes) {
+#ifdef __linux__
+	munmap(memory, mapping_size(bytes));
+#else
+	::operator delete(memory, std::align_val_t{page_size});
+#endif
+}
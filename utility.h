@@ -2,9 +2,11 @@
 #define UTILITY
 
 #include <cmath>
+#include <cstddef>
 #include <cxxabi.h>
 #include <limits>
 #include <memory>
+#include <new>
 #include <string>
 #include <type_traits>
 #include <utility>
@@ -104,6 +106,107 @@ namespace Utility {
 		}
 	};
 
+	template <class T>
+	struct Member_pointer_traits;
+	template <class Class_type, class Member_type>
+	struct Member_pointer_traits<Member_type Class_type::*> {
+		using Class = Class_type;
+		using Member = Member_type;
+	};
+
+	//contiguous range of elements that are owned by someone else
+	template <class T>
+	struct Span {
+		T *data() const {
+			return pointer;
+		}
+		std::size_t size() const {
+			return count;
+		}
+		bool empty() const {
+			return count == 0;
+		}
+		T &operator[](std::size_t index) const {
+			return pointer[index];
+		}
+		T *begin() const {
+			return pointer;
+		}
+		T *end() const {
+			return pointer + count;
+		}
+
+		T *pointer;
+		std::size_t count;
+	};
+
+	//allocator that aligns all allocations to alignment bytes, for example to the size of SIMD registers or cache lines
+	template <class T, std::size_t alignment>
+	struct Aligned_allocator {
+		using value_type = T;
+		template <class U>
+		struct rebind {
+			using other = Aligned_allocator<U, alignment>;
+		};
+		Aligned_allocator() = default;
+		template <class U>
+		Aligned_allocator(const Aligned_allocator<U, alignment> & /*unused*/) {}
+		T *allocate(std::size_t n) {
+			return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t{alignment}));
+		}
+		void deallocate(T *p, std::size_t /*unused*/) {
+			::operator delete(p, std::align_val_t{alignment});
+		}
+		template <class U>
+		bool operator==(const Aligned_allocator<U, alignment> & /*unused*/) const {
+			return true;
+		}
+		template <class U>
+		bool operator!=(const Aligned_allocator<U, alignment> & /*unused*/) const {
+			return false;
+		}
+	};
+
+	//map bytes of memory that the OS backs with huge pages where it can, which saves TLB misses when iterating over large pools. Sizes are rounded up to
+	//whole pages, so use it for big vectors that are reserved up front and not for many small ones.
+	void *allocate_huge_pages(std::size_t bytes);
+	void deallocate_huge_pages(void *memory, std::size_t bytes);
+	template <class T>
+	struct Huge_page_allocator {
+		using value_type = T;
+		Huge_page_allocator() = default;
+		template <class U>
+		Huge_page_allocator(const Huge_page_allocator<U> & /*unused*/) {}
+		T *allocate(std::size_t n) {
+			return static_cast<T *>(allocate_huge_pages(n * sizeof(T)));
+		}
+		void deallocate(T *p, std::size_t n) {
+			deallocate_huge_pages(p, n * sizeof(T));
+		}
+		template <class U>
+		bool operator==(const Huge_page_allocator<U> & /*unused*/) const {
+			return true;
+		}
+		template <class U>
+		bool operator!=(const Huge_page_allocator<U> & /*unused*/) const {
+			return false;
+		}
+	};
+
+#if defined(__clang__)
+#define VECTORIZE_LOOP _Pragma("clang loop vectorize(assume_safety)")
+#elif defined(__GNUC__)
+#define VECTORIZE_LOOP _Pragma("GCC ivdep")
+#else
+#define VECTORIZE_LOOP
+#endif
+
+	//promise the compiler that pointer is aligned to alignment bytes so it can use aligned vector loads
+	template <std::size_t alignment, class T>
+	T *assume_aligned(T *pointer) {
+		return static_cast<T *>(__builtin_assume_aligned(pointer, alignment));
+	}
+
 	template <class T>
 	std::string type_name() {
 		std::size_t size{0};
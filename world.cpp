@@ -0,0 +1,49 @@
+#include "world.h"
+#include "entity.h"
+#include "staging.h"
+
+std::array<ECS::World::Remove_function, ECS::Impl::max_component_types> ECS::World::destroy_table;
+std::atomic<std::size_t> ECS::World::component_type_count;
+
+ECS::World::~World() {
+	//entity and component destructors work on the current world
+	const Scope scope(*this);
+	//batches that were never merged, their entities never existed
+	for (auto batch = staged_batches.exchange(nullptr); batch;) {
+		delete std::exchange(batch, batch->next);
+	}
+	Entity::clear_all();
+	//systems and other states may own entities, they are destroyed while the pools still exist
+	while (!states.empty()) {
+		const auto state = std::move(states.back().state);
+		states.pop_back();
+	}
+	for (std::size_t i = 0; i < pools.size(); i++) {
+		if (const auto pool = pools[i].load(std::memory_order_relaxed)) {
+			pool_deleters[i](pool);
+		}
+	}
+}
+
+ECS::World &ECS::World::get_default() {
+	static World world;
+	return world;
+}
+
+void *ECS::World::create_pool(std::size_t index, void *(*make)(), void (*destroy)(void *)) {
+	const std::lock_guard<std::mutex> lock(pools_mutex);
+	if (const auto pool = pools[index].load(std::memory_order_relaxed)) {
+		return pool;
+	}
+	pool_deleters[index] = destroy;
+	const auto pool = make();
+	pools[index].store(pool, std::memory_order_release);
+	return pool;
+}
+
+std::size_t ECS::World::register_component_type(Remove_function remove_function) {
+	const auto index = component_type_count++;
+	assert_fast(index < Impl::max_component_types); //increase ECS_MAX_COMPONENT_TYPES
+	destroy_table[index] = remove_function;
+	return index;
+}
\ No newline at end of file
@@ -0,0 +1,142 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include "change_log.h"
+#include "column_pool.h"
+#include "ecs_impl.h"
+#include "pool.h"
+#include "signature.h"
+#include "tag_pool.h"
+#include "utility/asserts.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace ECS {
+	struct Staging_buffer;
+	namespace Impl {
+		struct Entity_base;
+		struct Snapshot_access;
+		struct Staged_batch;
+	} // namespace Impl
+	/*
+	A World owns entities, components, systems, the entities waiting in Expiry, the change tick and the profiler frames. Worlds share no mutable state, so
+	independent simulations such as shards or rooms can run at the same time on different threads, each with its own workers for System::run_systems.
+	The rest of the API (Entity, Entity_handle, System, Command_buffer, Expiry, Snapshot, Profiler) works on the current world of the calling thread. That
+	is the default world unless a World::Scope makes another world current, so programs with one world don't need to know about worlds at all.
+	Entities, handles and iterators belong to the world that was current when they were created and must only be used while it is current. An Entity
+	remembers its world and is destroyed there, so containers of Entities may outlive a Scope but not the world.
+	Other threads may only add to a world through a Staging_buffer.
+	Component types are numbered once per process, so one type has the same position in the Signatures of all worlds.
+	*/
+	struct World {
+		World() = default;
+		World(const World &) = delete;
+		World &operator=(const World &) = delete;
+		//destroys the entities, components and systems of the world
+		~World();
+
+		//the world the calling thread works on
+		static World &current() {
+			return current_world ? *current_world : *(current_world = &get_default());
+		}
+		//the world of threads that have no Scope, it lives until the end of the program
+		static World &get_default();
+		//makes a world current on the calling thread until the Scope ends
+		struct Scope {
+			explicit Scope(World &world)
+				: previous(std::exchange(current_world, &world)) {}
+			Scope(const Scope &) = delete;
+			Scope &operator=(const Scope &) = delete;
+			~Scope() {
+				current_world = previous;
+			}
+
+			private:
+			World *previous;
+		};
+		//makes a world current on the calling thread for good, for threads that only ever work on one world such as the workers of run_systems
+		static void make_current(World &world) {
+			current_world = &world;
+		}
+
+		//the pool of a component type, created on first use. Creating pools is thread safe, so parallel systems may use types that were never used before.
+		template <class Component>
+		Impl::Pool<Component> &get_pool() {
+			const auto index = type_index<Component>();
+			if (const auto pool = pools[index].load(std::memory_order_acquire)) {
+				return *static_cast<Impl::Pool<Component> *>(pool);
+			}
+			//creating is rare and kept out of line, so the loops that get components keep their registers
+			return *static_cast<Impl::Pool<Component> *>(create_pool(
+				index, [] { return static_cast<void *>(new Impl::Pool<Component>); }, [](void *pool) { delete static_cast<Impl::Pool<Component> *>(pool); }));
+		}
+		//state of a module that is only known in its translation unit, such as the registered systems or the expiry timers. Created on first use, not
+		//thread safe.
+		template <class State>
+		State &get_state() {
+			for (auto &module_state : states) {
+				if (module_state.key == Impl::type_key<State>()) {
+					return *static_cast<State *>(module_state.state.get());
+				}
+			}
+			states.push_back({Impl::type_key<State>(), {new State, [](void *state) { delete static_cast<State *>(state); }}});
+			return *static_cast<State *>(states.back().state.get());
+		}
+
+		private:
+		//removes the components of one type of count entities with sorted ids from the current world
+		using Remove_function = void (*)(const Impl::Id_t *ids, std::size_t count);
+		template <class Component>
+		static void remover(const Impl::Id_t *ids, std::size_t count) {
+			current().get_pool<Component>().erase_sorted(ids, count);
+		}
+		//dense index of a component type, the bit of the type in Signatures, its position in destroy_table and the slot of its pool in every world
+		template <class Component>
+		static std::size_t type_index() {
+			static const std::size_t index = register_component_type(remover<Component>);
+			return index;
+		}
+		static std::size_t register_component_type(Remove_function remove_function);
+		//returns the pool with the given type index, making it with make if the world has none yet
+		void *create_pool(std::size_t index, void *(*make)(), void (*destroy)(void *));
+
+		//pools[i] is the pool of the component type with the type index i or nullptr if the world never used the type
+		std::array<std::atomic<void *>, Impl::max_component_types> pools{};
+		std::array<void (*)(void *), Impl::max_component_types> pool_deleters{};
+		std::mutex pools_mutex;
+		//generations[i] is the generation of the entity that currently has or will next get the index i
+		std::vector<Impl::Generation_t> generations;
+		//indexes below next_index have been handed out. Indexes reserved by Staging_buffers on other threads may not be in generations yet.
+		std::atomic<std::size_t> next_index{0};
+		//min heap of the indexes of destroyed entities
+		std::vector<Impl::Index_t> free_indexes;
+		Impl::Signature_table signatures;
+		std::atomic<Changes::Tick_t> tick{1};
+		struct Module_state {
+			const void *key;
+			std::unique_ptr<void, void (*)(void *)> state;
+		};
+		std::vector<Module_state> states;
+		//batches submitted by Staging_buffers, newest first, waiting for Staging_buffer::merge
+		std::atomic<Impl::Staged_batch *> staged_batches{nullptr};
+
+		//defined inline so that using it needs no call to a thread_local wrapper function
+		static inline thread_local World *current_world = nullptr;
+		//destroy_table[i] removes the components with the type index i
+		static std::array<Remove_function, Impl::max_component_types> destroy_table;
+		static std::atomic<std::size_t> component_type_count;
+		friend struct Impl::Entity_base;
+		friend struct Impl::Snapshot_access;
+		friend struct Staging_buffer;
+		friend Changes::Tick_t Changes::current_tick();
+		friend Changes::Tick_t Changes::advance_tick();
+	};
+} // namespace ECS
+
+#endif // WORLD_H